@@ -32,6 +32,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include "tractorbeam/debug.h"
+#include "tractorbeam/digest.h"
+#include "tractorbeam/serve.h"
 #include "tractorbeam/zkrecv.h"
 #include "tractorbeam/zksend.h"
 #include "tractorbeam/helpers.h"
@@ -40,7 +42,11 @@
 #define TB_DEFAULT_ENDPOINT "localhost:2181"
 #define TB_DEFAULT_TIMEOUT 5000
 #define TB_DEFAULT_DELAY 5
+#define TB_DEFAULT_MIN_INTERVAL 1000
 #define TB_RECV_BUFSIZE 2097152
+#define TB_DEFAULT_NAMES_MEMORY 33554432
+#define TB_DEFAULT_SHM_SIZE 33554432
+#define TB_DEFAULT_LAZY_LIMIT 1024
 
 static
 int __tractorbeam_check_send(tractorbeam_zksend_t *sendcfg)
@@ -58,9 +64,30 @@ int __tractorbeam_check_send(tractorbeam_zksend_t *sendcfg)
     rc = 1;
   }
 
-  if (sendcfg->exec == NULL || strcmp("", sendcfg->exec) == 0)
+  int sources = (strcmp("", sendcfg->exec) != 0)
+              + (sendcfg->watch != NULL)
+              + (sendcfg->fifo != NULL);
+  if (sources != 1)
   {
-    printf("ERROR: exec must not be null\n");
+    printf("ERROR: exactly one of exec, watch-file or fifo must be given\n");
+    rc = 1;
+  }
+
+  if (sendcfg->min_delay <= 0 || sendcfg->max_delay < sendcfg->min_delay)
+  {
+    printf("ERROR: min-delay must be >0 and max-delay >=min-delay\n");
+    rc = 1;
+  }
+
+  if (sendcfg->fail_threshold < 1 || sendcfg->recover_threshold < 1)
+  {
+    printf("ERROR: fail-threshold and recover-threshold must be >=1\n");
+    rc = 1;
+  }
+
+  if (sendcfg->min_interval < 0)
+  {
+    printf("ERROR: min-interval must be >=0\n");
     rc = 1;
   }
 
@@ -84,6 +111,72 @@ int __tractorbeam_check_recv(tractorbeam_zkrecv_t *recvcfg)
     rc = 1;
   }
 
+  if (recvcfg->output[0] == '\0' && recvcfg->ntemplates == 0)
+  {
+    printf("ERROR: output must not be null (unless there are templates)\n");
+    rc = 1;
+  }
+
+  if (recvcfg->layout == ZKRECV_LAYOUT_SHM && recvcfg->output[0] != '/' && recvcfg->output[0] != '\0')
+  {
+    printf("ERROR: output must be a name starting with / for the shm layout\n");
+    rc = 1;
+  }
+
+  if (recvcfg->zxid != -1 && (recvcfg->zxid < 0 || recvcfg->from_snapshot == NULL))
+  {
+    printf("ERROR: zxid must be >=0 and requires from-snapshot\n");
+    rc = 1;
+  }
+
+  if (recvcfg->diff_against != NULL && (recvcfg->layout != ZKRECV_LAYOUT_FILE || recvcfg->from_snapshot != NULL))
+  {
+    printf("ERROR: diff-against requires the file layout and can not be used with from-snapshot\n");
+    rc = 1;
+  }
+
+  if (recvcfg->digests != NULL && recvcfg->from_snapshot != NULL)
+  {
+    printf("ERROR: digests can not be used with from-snapshot\n");
+    rc = 1;
+  }
+
+  if (recvcfg->max_depth < -1)
+  {
+    printf("ERROR: max-depth must be >=0\n");
+    rc = 1;
+  }
+
+  if ((recvcfg->nincludes > 0 || recvcfg->nexcludes > 0 || recvcfg->max_depth >= 0) && recvcfg->from_snapshot != NULL)
+  {
+    printf("ERROR: include, exclude and max-depth can not be used with from-snapshot\n");
+    rc = 1;
+  }
+
+  if ((recvcfg->data != MONITOR_DATA_ALL || recvcfg->layout == ZKRECV_LAYOUT_STAT) && recvcfg->from_snapshot != NULL)
+  {
+    printf("ERROR: data and the stat layout can not be used with from-snapshot\n");
+    rc = 1;
+  }
+
+  if (recvcfg->data != MONITOR_DATA_ALL && (recvcfg->diff_against != NULL || recvcfg->digests != NULL))
+  {
+    printf("ERROR: data can not be used with diff-against or digests\n");
+    rc = 1;
+  }
+
+  if (recvcfg->lazy_limit < 0)
+  {
+    printf("ERROR: lazy-limit must be >=0\n");
+    rc = 1;
+  }
+
+  if (recvcfg->io_threads < 0)
+  {
+    printf("ERROR: io-threads must be >=0\n");
+    rc = 1;
+  }
+
   return(rc);
 }
 
@@ -135,10 +228,56 @@ void __printf_indent(const char *a, const char *b, size_t maxlen)
   free(tmp);
 }
 
+static
+int __tractorbeam_check_serve(tractorbeam_serve_t *servecfg)
+{
+  int rc = 0;
+
+  if (servecfg->path == NULL || strcmp("", servecfg->path) == 0)
+  {
+    printf("ERROR: path must not be null\n");
+    rc = 1;
+  }
+
+  if (servecfg->socket == NULL || strcmp("", servecfg->socket) == 0)
+  {
+    printf("ERROR: socket must not be null\n");
+    rc = 1;
+  }
+
+  if (servecfg->min_interval < 0)
+  {
+    printf("ERROR: min-interval must be >=0\n");
+    rc = 1;
+  }
+
+  if (servecfg->rebalance < -1)
+  {
+    printf("ERROR: rebalance must be >=0\n");
+    rc = 1;
+  }
+
+  return(rc);
+}
+
+static
+int __tractorbeam_check_compare(tractorbeam_compare_t *comparecfg)
+{
+  int rc = 0;
+
+  if (comparecfg->digests == NULL || comparecfg->against == NULL)
+  {
+    printf("ERROR: digests and against must not be null\n");
+    rc = 1;
+  }
+
+  return(rc);
+}
+
 static
 void __tractorbeam_print_usage0(const char *prg)
 {
-  printf("USAGE: %s {send,recv} OPTIONS...\n\n", prg);
+  printf("USAGE: %s {send,recv,serve,compare} OPTIONS...\n\n", prg);
   printf("  tip: use --help after the sub-comamnd to get a list of available options\n");
 }
 
@@ -152,23 +291,64 @@ void __tractorbeam_print_sendusage(const char *prg)
                       "  the output of a given program into a ephemeral node.", 60);
 
   snprintf(buffer, 1024, "The zookeeper cluster to connect to [default:%s];", TB_DEFAULT_ENDPOINT);
-  __printf_indent("  --zookeeper STRING  ", buffer, 76);
+  __printf_indent("  --zookeeper STRING       ", buffer, 76);
 
   snprintf(buffer, 1024, "The path of the ephemeral node you want to create;");
-  __printf_indent("  --path STRING       ", buffer, 76);
+  __printf_indent("  --path STRING            ", buffer, 76);
 
   snprintf(buffer, 1024, "The image to invoke. This should be the an absolute path (but it is"
                          " not enforced);");
-  __printf_indent("  --exec FILE         ", buffer, 76);
+  __printf_indent("  --exec FILE              ", buffer, 76);
+
+  snprintf(buffer, 1024, "Publishes the contents of this file whenever it changes (a writer"
+                         " closes it or it gets renamed into place), instead of using --exec"
+                         " (linux only);");
+  __printf_indent("  --watch-file FILE        ", buffer, 76);
+
+  snprintf(buffer, 1024, "Publishes what every writer of this fifo writes into it, instead of"
+                         " using --exec;");
+  __printf_indent("  --fifo FILE              ", buffer, 76);
+
+  snprintf(buffer, 1024, "The minimum interval between updates when using --watch-file or"
+                         " --fifo [default:%d];", TB_DEFAULT_MIN_INTERVAL);
+  __printf_indent("  --min-interval MILLISECS ", buffer, 76);
 
   snprintf(buffer, 1024, "Defines the interval at which the program gets called. The amount of"
                          " time the program spent during its thing is not taken into account,"
                          " but the runtime may not exceed this value [default:%d];", TB_DEFAULT_DELAY);
-  __printf_indent("  --delay SECONDS     ", buffer, 76);
+  __printf_indent("  --delay SECONDS          ", buffer, 76);
+
+  snprintf(buffer, 1024, "The interval used when the output changes or the program fails."
+                         " The runtime may not exceed this value [default: --delay];");
+  __printf_indent("  --min-delay SECONDS      ", buffer, 76);
+
+  snprintf(buffer, 1024, "The interval doubles, up to this value, while the output does not"
+                         " change (and the node is not rewritten) [default: --min-delay];");
+  __printf_indent("  --max-delay SECONDS      ", buffer, 76);
 
   snprintf(buffer, 1024, "This defines how much time without communication zookeeper should"
                          " consider the client still alive [default:%d];", TB_DEFAULT_TIMEOUT);
-  __printf_indent("  --timeout MILLISECS ", buffer, 76);
+  __printf_indent("  --timeout MILLISECS      ", buffer, 76);
+
+  snprintf(buffer, 1024, "Reduces the memory footprint, for hosts running many instances"
+                         " (smaller thread stacks and a single malloc arena);");
+  __printf_indent("  --lean                   ", buffer, 76);
+
+  snprintf(buffer, 1024, "Parses the output as key=value lines and writes each key as an"
+                         " ephemeral child of --path (which must exist), updating only the keys"
+                         " that have changed;");
+  __printf_indent("  --fanout                 ", buffer, 76);
+
+  snprintf(buffer, 1024, "The number of consecutive failures (timeout, non-zero exit code,"
+                         " output too large, ...) before the node gets removed [default:1];");
+  __printf_indent("  --fail-threshold N       ", buffer, 76);
+
+  snprintf(buffer, 1024, "The number of consecutive successes before the node gets created"
+                         " again, once removed [default:1];");
+  __printf_indent("  --recover-threshold N    ", buffer, 76);
+
+  snprintf(buffer, 1024, "Writes this string into the node instead of removing it;");
+  __printf_indent("  --degraded STRING        ", buffer, 76);
 
 }
 
@@ -192,8 +372,112 @@ void __tractorbeam_print_recvusage(const char *prg)
   __printf_indent("  --output FILE              ", buffer, 76);
 
   snprintf(buffer, 1024, "The layout to use when dumping the zookeeper tree. `filesystem' uses"
-                         " files and directories and `file' uses a single file [default:file];\n");
-  __printf_indent("  --layout {filesystem,file} ", buffer, 76);
+                         " files and directories, `file' uses a single file, `shm' publishes"
+                         " a snapshot into the shared memory segment named by --output,"
+                         " `stat' writes the metadata of every node into a single file and"
+                         " `json' writes a json object (path, metadata and contents) per line"
+                         " [default:file];");
+  __printf_indent("  --layout LAYOUT            ", buffer, 76);
+
+  snprintf(buffer, 1024, "Probes the servers and connects to observers and to the fastest ones"
+                         " first;");
+  __printf_indent("  --rebalance                ", buffer, 76);
+
+  snprintf(buffer, 1024, "The maximum number of requests per second issued while reading the"
+                         " tree [default:unlimited];");
+  __printf_indent("  --max-rps NUMBER           ", buffer, 76);
+
+  snprintf(buffer, 1024, "The maximum number of bytes per second read from zookeeper"
+                         " [default:unlimited];");
+  __printf_indent("  --max-bps NUMBER           ", buffer, 76);
+
+  snprintf(buffer, 1024, "Halves the request rate whenever the latency goes above this value"
+                         " (requires --max-rps or --max-bps) [default:disabled];");
+  __printf_indent("  --target-latency MILLISECS ", buffer, 76);
+
+  snprintf(buffer, 1024, "The memory used to hold the names of nodes not yet visited. Beyond"
+                         " this, names go into temporary files [default:%d];", TB_DEFAULT_NAMES_MEMORY);
+  __printf_indent("  --names-memory BYTES       ", buffer, 76);
+
+  snprintf(buffer, 1024, "Visits the children of every node in ascending order;");
+  __printf_indent("  --sorted                   ", buffer, 76);
+
+  snprintf(buffer, 1024, "The largest node contents allowed. Reading a larger node makes"
+                         " the whole operation fail [default:%d];", TB_RECV_BUFSIZE);
+  __printf_indent("  --max-data BYTES           ", buffer, 76);
+
+  snprintf(buffer, 1024, "The room for each snapshot in the shared memory segment, which"
+                         " holds two of them. Only used when the segment gets created"
+                         " [default:%d];", TB_DEFAULT_SHM_SIZE);
+  __printf_indent("  --shm-size BYTES           ", buffer, 76);
+
+  snprintf(buffer, 1024, "Reads the tree out of the snapshot and transaction log files of a"
+                         " zookeeper server (its dataDir/version-2) instead of connecting to"
+                         " the cluster;");
+  __printf_indent("  --from-snapshot DIR        ", buffer, 76);
+
+  snprintf(buffer, 1024, "Stops replaying the transaction logs after this zxid (requires"
+                         " --from-snapshot) [default:all];");
+  __printf_indent("  --zxid ZXID                ", buffer, 76);
+
+  snprintf(buffer, 1024, "Compares the tree with a previous dump (layout=file, taken with"
+                         " --sorted) and writes the added, modified and removed nodes into"
+                         " --changes, with their old and new versions. The dump is written as"
+                         " well, its versions into OUTPUT.versions (implies --sorted);");
+  __printf_indent("  --diff-against FILE        ", buffer, 76);
+
+  snprintf(buffer, 1024, "The file to write the changes into. Use - to write into the stdout"
+                         " [default:-];");
+  __printf_indent("  --changes FILE             ", buffer, 76);
+
+  snprintf(buffer, 1024, "Writes a merkle digest of every node (and its subtree) into this"
+                         " file, to be compared using `compare' (implies --sorted);");
+  __printf_indent("  --digests FILE             ", buffer, 76);
+
+  snprintf(buffer, 1024, "Renders the template SRC into DST using the tree and runs CMD"
+                         " (using /bin/sh) when DST changes. The file is replaced only if"
+                         " the output differs. May be given more than once and --output may"
+                         " be omitted;");
+  __printf_indent("  --template SRC:DST[:CMD]   ", buffer, 76);
+
+  snprintf(buffer, 1024, "Reads only the nodes matching this pattern (e.g."
+                         " /services/*/instances/*, ** matches any number of levels). Their"
+                         " parents are listed but their contents are not read. May be given"
+                         " more than once [default:all];");
+  __printf_indent("  --include PATTERN          ", buffer, 76);
+
+  snprintf(buffer, 1024, "Skips the nodes matching this pattern and their subtrees, with no"
+                         " requests issued for them. May be given more than once;");
+  __printf_indent("  --exclude PATTERN          ", buffer, 76);
+
+  snprintf(buffer, 1024, "The deepest level to read, --path being 0 [default:unlimited];");
+  __printf_indent("  --max-depth NUMBER         ", buffer, 76);
+
+  snprintf(buffer, 1024, "The contents to read. `none' reads the metadata only (a single"
+                         " request per node) and `lazy' reads the contents of leaves and of"
+                         " nodes smaller than --lazy-limit only. Contents not read are left"
+                         " empty [default:all];");
+  __printf_indent("  --data MODE                ", buffer, 76);
+
+  snprintf(buffer, 1024, "The size under which --data lazy reads the contents of nodes with"
+                         " children [default:%d];", TB_DEFAULT_LAZY_LIMIT);
+  __printf_indent("  --lazy-limit BYTES         ", buffer, 76);
+
+  snprintf(buffer, 1024, "Creates the directories and files of the filesystem layout using"
+                         " this many threads, while the tree is still being read (0 writes"
+                         " them as they are read) [default:0];\n");
+  __printf_indent("  --io-threads NUMBER        ", buffer, 76);
+}
+
+static
+int __tractorbeam_append(char ***list, int *count, int argc, char *value)
+{
+  if (*list == NULL)
+  { *list = (char **) malloc(sizeof(char*) * argc); }
+  if (*list == NULL)
+  { return(-1); }
+  (*list)[(*count)++] = value;
+  return(0);
 }
 
 static
@@ -204,6 +488,26 @@ int __tractorbeam_parse_recvopts(int argc, char *argv[], tractorbeam_zkrecv_t *r
     {"path",          required_argument, NULL, 0 },
     {"output",        required_argument, NULL, 0 },
     {"layout",        required_argument, NULL, 0 },
+    {"rebalance",     no_argument,       NULL, 0 },
+    {"max-rps",       required_argument, NULL, 0 },
+    {"max-bps",       required_argument, NULL, 0 },
+    {"target-latency", required_argument, NULL, 0 },
+    {"names-memory",  required_argument, NULL, 0 },
+    {"sorted",        no_argument,       NULL, 0 },
+    {"max-data",      required_argument, NULL, 0 },
+    {"shm-size",      required_argument, NULL, 0 },
+    {"from-snapshot", required_argument, NULL, 0 },
+    {"zxid",          required_argument, NULL, 0 },
+    {"diff-against",  required_argument, NULL, 0 },
+    {"changes",       required_argument, NULL, 0 },
+    {"digests",       required_argument, NULL, 0 },
+    {"template",      required_argument, NULL, 0 },
+    {"include",       required_argument, NULL, 0 },
+    {"exclude",       required_argument, NULL, 0 },
+    {"max-depth",     required_argument, NULL, 0 },
+    {"data",          required_argument, NULL, 0 },
+    {"lazy-limit",    required_argument, NULL, 0 },
+    {"io-threads",    required_argument, NULL, 0 },
     {"help",          no_argument,       NULL, 0 },
     {0,               0,                 NULL, 0 }
   };
@@ -228,12 +532,79 @@ int __tractorbeam_parse_recvopts(int argc, char *argv[], tractorbeam_zkrecv_t *r
         { recvcfg->layout = ZKRECV_LAYOUT_FILE; }
         else if (strcmp("filesystem", optarg) == 0)
         { recvcfg->layout = ZKRECV_LAYOUT_FILESYSTEM; }
+        else if (strcmp("shm", optarg) == 0)
+        { recvcfg->layout = ZKRECV_LAYOUT_SHM; }
+        else if (strcmp("stat", optarg) == 0)
+        { recvcfg->layout = ZKRECV_LAYOUT_STAT; }
+        else if (strcmp("json", optarg) == 0)
+        { recvcfg->layout = ZKRECV_LAYOUT_JSON; }
         else
         {
           printf("ERROR: invalid layout\n");
           return(-1);
         }
       }
+      else if (opt == 4)
+      { recvcfg->rebalance = 1; }
+      else if (opt == 5)
+      { recvcfg->max_rps = atoi(optarg); }
+      else if (opt == 6)
+      { recvcfg->max_bps = atol(optarg); }
+      else if (opt == 7)
+      { recvcfg->target_latency = atoi(optarg); }
+      else if (opt == 8)
+      { recvcfg->names_memory = atol(optarg); }
+      else if (opt == 9)
+      { recvcfg->sorted = 1; }
+      else if (opt == 10)
+      { recvcfg->max_data = atol(optarg); }
+      else if (opt == 11)
+      { recvcfg->shm_size = atol(optarg); }
+      else if (opt == 12)
+      { recvcfg->from_snapshot = optarg; }
+      else if (opt == 13)
+      { recvcfg->zxid = (int64_t) strtoll(optarg, NULL, 0); }
+      else if (opt == 14)
+      { recvcfg->diff_against = optarg; }
+      else if (opt == 15)
+      { recvcfg->changes = optarg; }
+      else if (opt == 16)
+      { recvcfg->digests = optarg; }
+      else if (opt == 17)
+      {
+        if (__tractorbeam_append(&recvcfg->templates, &recvcfg->ntemplates, argc, optarg) != 0)
+        { return(-1); }
+      }
+      else if (opt == 18)
+      {
+        if (__tractorbeam_append(&recvcfg->includes, &recvcfg->nincludes, argc, optarg) != 0)
+        { return(-1); }
+      }
+      else if (opt == 19)
+      {
+        if (__tractorbeam_append(&recvcfg->excludes, &recvcfg->nexcludes, argc, optarg) != 0)
+        { return(-1); }
+      }
+      else if (opt == 20)
+      { recvcfg->max_depth = atoi(optarg); }
+      else if (opt == 21)
+      {
+        if (strcmp("all", optarg) == 0)
+        { recvcfg->data = MONITOR_DATA_ALL; }
+        else if (strcmp("none", optarg) == 0)
+        { recvcfg->data = MONITOR_DATA_NONE; }
+        else if (strcmp("lazy", optarg) == 0)
+        { recvcfg->data = MONITOR_DATA_LAZY; }
+        else
+        {
+          printf("ERROR: invalid data\n");
+          return(-1);
+        }
+      }
+      else if (opt == 22)
+      { recvcfg->lazy_limit = atol(optarg); }
+      else if (opt == 23)
+      { recvcfg->io_threads = atoi(optarg); }
       else
       { return(-1); }
     }
@@ -253,6 +624,16 @@ int __tractorbeam_parse_sendopts(int argc, char *argv[], tractorbeam_zksend_t *s
     {"exec",          required_argument, NULL, 0 },
     {"timeout",       required_argument, NULL, 0 },
     {"delay",         required_argument, NULL, 0 },
+    {"lean",          no_argument,       NULL, 0 },
+    {"watch-file",    required_argument, NULL, 0 },
+    {"fifo",          required_argument, NULL, 0 },
+    {"min-interval",  required_argument, NULL, 0 },
+    {"fanout",        no_argument,       NULL, 0 },
+    {"fail-threshold", required_argument, NULL, 0 },
+    {"recover-threshold", required_argument, NULL, 0 },
+    {"degraded",      required_argument, NULL, 0 },
+    {"min-delay",     required_argument, NULL, 0 },
+    {"max-delay",     required_argument, NULL, 0 },
     {"help",          no_argument,       NULL, 0 },
     {0,               0,                 NULL, 0 }
   };
@@ -275,6 +656,26 @@ int __tractorbeam_parse_sendopts(int argc, char *argv[], tractorbeam_zksend_t *s
       { sendcfg->timeout = atoi(optarg); }
       else if (opt == 4)
       { sendcfg->delay = atoi(optarg); }
+      else if (opt == 5)
+      { sendcfg->lean = 1; }
+      else if (opt == 6)
+      { sendcfg->watch = optarg; }
+      else if (opt == 7)
+      { sendcfg->fifo = optarg; }
+      else if (opt == 8)
+      { sendcfg->min_interval = atoi(optarg); }
+      else if (opt == 9)
+      { sendcfg->fanout = 1; }
+      else if (opt == 10)
+      { sendcfg->fail_threshold = atoi(optarg); }
+      else if (opt == 11)
+      { sendcfg->recover_threshold = atoi(optarg); }
+      else if (opt == 12)
+      { sendcfg->degraded = optarg; }
+      else if (opt == 13)
+      { sendcfg->min_delay = atoi(optarg); }
+      else if (opt == 14)
+      { sendcfg->max_delay = atoi(optarg); }
       else
       { return(-1); }
     }
@@ -289,9 +690,140 @@ int __tractorbeam_parse_sendopts(int argc, char *argv[], tractorbeam_zksend_t *s
   { sendcfg->argv[1+k-optind] = argv[k]; }
   sendcfg->argv[1+k-optind] = NULL;
 
+  if (sendcfg->min_delay == 0)
+  { sendcfg->min_delay = sendcfg->delay; }
+  if (sendcfg->max_delay == 0)
+  { sendcfg->max_delay = sendcfg->min_delay; }
+
   return(__tractorbeam_check_send(sendcfg));
 }
 
+static
+void __tractorbeam_print_serveusage(const char *prg)
+{
+  char buffer[1024];
+  printf("USAGE: %s serve OPTIONS...\n", prg);
+
+  __printf_indent("", "  This program keeps a zookeeper tree in memory, updated through"
+                      "  watches, and answers lookups from local processes over a unix"
+                      "  socket.", 60);
+
+  snprintf(buffer, 1024, "The zookeeper cluster to connect to [default:%s];", TB_DEFAULT_ENDPOINT);
+  __printf_indent("  --zookeeper STRING         ", buffer, 76);
+
+  snprintf(buffer, 1024, "The tree you want to serve;");
+  __printf_indent("  --path STRING              ", buffer, 76);
+
+  snprintf(buffer, 1024, "The unix socket to listen on;");
+  __printf_indent("  --socket FILE              ", buffer, 76);
+
+  snprintf(buffer, 1024, "The minimum interval between two reloads of the tree. Changes"
+                         " in between get coalesced [default:%d];", TB_DEFAULT_MIN_INTERVAL);
+  __printf_indent("  --min-interval MILLISECS   ", buffer, 76);
+
+  snprintf(buffer, 1024, "Probes the servers and connects to observers and to the fastest ones"
+                         " first. The probe is repeated every SECONDS and the session moves if"
+                         " the preferred server changes (0 probes only once) [default:disabled];");
+  __printf_indent("  --rebalance SECONDS        ", buffer, 76);
+
+  snprintf(buffer, 1024, "The largest node contents allowed [default:%d];\n", TB_RECV_BUFSIZE);
+  __printf_indent("  --max-data BYTES           ", buffer, 76);
+}
+
+static
+int __tractorbeam_parse_serveopts(int argc, char *argv[], tractorbeam_serve_t *servecfg)
+{
+  static struct option my_options[] = {
+    {"zookeeper",     required_argument, NULL, 0 },
+    {"path",          required_argument, NULL, 0 },
+    {"socket",        required_argument, NULL, 0 },
+    {"min-interval",  required_argument, NULL, 0 },
+    {"max-data",      required_argument, NULL, 0 },
+    {"rebalance",     required_argument, NULL, 0 },
+    {"help",          no_argument,       NULL, 0 },
+    {0,               0,                 NULL, 0 }
+  };
+
+  while (1)
+  {
+    int opt = 0;
+    int rc  = getopt_long_only(argc, argv, "", my_options, &opt);
+    if (rc == -1)
+    { break; }
+    else if (rc == 0)
+    {
+      if (opt == 0)
+      { servecfg->endpoint = optarg; }
+      else if (opt == 1)
+      { servecfg->path = optarg; }
+      else if (opt == 2)
+      { servecfg->socket = optarg; }
+      else if (opt == 3)
+      { servecfg->min_interval = atoi(optarg); }
+      else if (opt == 4)
+      { servecfg->max_data = atol(optarg); }
+      else if (opt == 5)
+      { servecfg->rebalance = atoi(optarg); }
+      else
+      { return(-1); }
+    }
+    else
+    { return(-1); }
+  }
+
+  return(__tractorbeam_check_serve(servecfg));
+}
+
+static
+void __tractorbeam_print_compareusage(const char *prg)
+{
+  char buffer[1024];
+  printf("USAGE: %s compare OPTIONS...\n", prg);
+
+  __printf_indent("", "  This program compares two digest files, written by recv, and"
+                      "  prints the nodes whose subtrees differ. It exits with 0 if the"
+                      "  trees are identical and 1 otherwise.", 60);
+
+  snprintf(buffer, 1024, "The digests file (nodes only here are prefixed by -);");
+  __printf_indent("  --digests FILE             ", buffer, 76);
+
+  snprintf(buffer, 1024, "The digests file to compare with (nodes only here are prefixed"
+                         " by + and nodes that differ by ~);\n");
+  __printf_indent("  --against FILE             ", buffer, 76);
+}
+
+static
+int __tractorbeam_parse_compareopts(int argc, char *argv[], tractorbeam_compare_t *comparecfg)
+{
+  static struct option my_options[] = {
+    {"digests",       required_argument, NULL, 0 },
+    {"against",       required_argument, NULL, 0 },
+    {"help",          no_argument,       NULL, 0 },
+    {0,               0,                 NULL, 0 }
+  };
+
+  while (1)
+  {
+    int opt = 0;
+    int rc  = getopt_long_only(argc, argv, "", my_options, &opt);
+    if (rc == -1)
+    { break; }
+    else if (rc == 0)
+    {
+      if (opt == 0)
+      { comparecfg->digests = optarg; }
+      else if (opt == 1)
+      { comparecfg->against = optarg; }
+      else
+      { return(-1); }
+    }
+    else
+    { return(-1); }
+  }
+
+  return(__tractorbeam_check_compare(comparecfg));
+}
+
 int main(int argc, char *argv[])
 {
   tractorbeam_zksend_t sendcfg;
@@ -301,6 +833,16 @@ int main(int argc, char *argv[])
   sendcfg.argv      = NULL;
   sendcfg.delay     = TB_DEFAULT_DELAY;
   sendcfg.timeout   = TB_DEFAULT_TIMEOUT;
+  sendcfg.lean      = 0;
+  sendcfg.watch     = NULL;
+  sendcfg.fifo      = NULL;
+  sendcfg.min_interval = TB_DEFAULT_MIN_INTERVAL;
+  sendcfg.fanout    = 0;
+  sendcfg.fail_threshold    = 1;
+  sendcfg.recover_threshold = 1;
+  sendcfg.degraded  = NULL;
+  sendcfg.min_delay = 0;
+  sendcfg.max_delay = 0;
 
   tractorbeam_zkrecv_t recvcfg;
   recvcfg.endpoint  = TB_DEFAULT_ENDPOINT;
@@ -309,6 +851,42 @@ int main(int argc, char *argv[])
   recvcfg.layout    = ZKRECV_LAYOUT_FILE;
   recvcfg.delay     = TB_DEFAULT_DELAY;
   recvcfg.timeout   = TB_DEFAULT_TIMEOUT;
+  recvcfg.rebalance = 0;
+  recvcfg.max_rps   = 0;
+  recvcfg.max_bps   = 0;
+  recvcfg.target_latency = 0;
+  recvcfg.names_memory = TB_DEFAULT_NAMES_MEMORY;
+  recvcfg.sorted    = 0;
+  recvcfg.max_data  = TB_RECV_BUFSIZE;
+  recvcfg.shm_size  = TB_DEFAULT_SHM_SIZE;
+  recvcfg.from_snapshot = NULL;
+  recvcfg.zxid      = -1;
+  recvcfg.diff_against = NULL;
+  recvcfg.changes   = "-";
+  recvcfg.digests   = NULL;
+  recvcfg.templates = NULL;
+  recvcfg.ntemplates = 0;
+  recvcfg.includes  = NULL;
+  recvcfg.nincludes = 0;
+  recvcfg.excludes  = NULL;
+  recvcfg.nexcludes = 0;
+  recvcfg.max_depth = -1;
+  recvcfg.data      = MONITOR_DATA_ALL;
+  recvcfg.lazy_limit = TB_DEFAULT_LAZY_LIMIT;
+  recvcfg.io_threads = 0;
+
+  tractorbeam_compare_t comparecfg;
+  comparecfg.digests = NULL;
+  comparecfg.against = NULL;
+
+  tractorbeam_serve_t servecfg;
+  servecfg.endpoint = TB_DEFAULT_ENDPOINT;
+  servecfg.path     = "";
+  servecfg.socket   = "";
+  servecfg.timeout  = TB_DEFAULT_TIMEOUT;
+  servecfg.min_interval = TB_DEFAULT_MIN_INTERVAL;
+  servecfg.rebalance    = -1;
+  servecfg.max_data = TB_RECV_BUFSIZE;
 
   if (argc < 2)
   {
@@ -335,10 +913,39 @@ int main(int argc, char *argv[])
     if (__tractorbeam_parse_recvopts(argc-1, argv+1, &recvcfg) != 0)
     {
       __tractorbeam_print_recvusage(argv[0]);
+      free(recvcfg.templates);
+      free(recvcfg.includes);
+      free(recvcfg.excludes);
+      return(-1);
+    }
+
+    int rc = tractorbeam_zkrecv(&recvcfg);
+    free(recvcfg.templates);
+    free(recvcfg.includes);
+    free(recvcfg.excludes);
+    return(rc);
+  }
+  else if (strcmp("serve", argv[1]) == 0)
+  {
+    argv[1] = argv[0];
+    if (__tractorbeam_parse_serveopts(argc-1, argv+1, &servecfg) != 0)
+    {
+      __tractorbeam_print_serveusage(argv[0]);
+      return(-1);
+    }
+
+    return(tractorbeam_serve(&servecfg));
+  }
+  else if (strcmp("compare", argv[1]) == 0)
+  {
+    argv[1] = argv[0];
+    if (__tractorbeam_parse_compareopts(argc-1, argv+1, &comparecfg) != 0)
+    {
+      __tractorbeam_print_compareusage(argv[0]);
       return(-1);
     }
 
-    return(tractorbeam_zkrecv(&recvcfg));
+    return(tractorbeam_compare(&comparecfg));
   }
   else
   {
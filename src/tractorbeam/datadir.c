@@ -0,0 +1,827 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/datadir.h"
+#include "tractorbeam/helpers.h"
+
+#define TBDD_SNAP_MAGIC 0x5a4b534e
+#define TBDD_LOG_MAGIC 0x5a4b4c47
+
+#define TBDD_OP_CREATE 1
+#define TBDD_OP_DELETE 2
+#define TBDD_OP_SETDATA 5
+#define TBDD_OP_MULTI 14
+#define TBDD_OP_CREATE2 15
+#define TBDD_OP_CREATECONTAINER 19
+#define TBDD_OP_DELETECONTAINER 20
+#define TBDD_OP_CREATETTL 21
+#define TBDD_OP_CLOSESESSION -11
+
+/* Files are jute records, which are big endian, with buffers and
+ * strings prefixed by their length (-1 meaning NULL). */
+typedef struct
+{
+  const unsigned char *base;
+  size_t size;
+  size_t off;
+  int err;
+} tbdd_cursor_t;
+
+typedef struct
+{
+  int64_t zxid;
+  char *name;
+} tbdd_file_t;
+
+typedef struct
+{
+  void *addr;
+  size_t size;
+} tbdd_map_t;
+
+/* The state of a node after replaying the logs. Paths and contents
+ * point into the (mapped) logs. Nodes the logs only changed or
+ * removed are "inherited": whether they exist at all is up to the
+ * snapshot. */
+typedef struct
+{
+  const char *path;
+  size_t pathlen;
+  const char *data;
+  int32_t datalen;
+  int64_t owner;
+  int hasdata;
+  int created;
+  int exists;
+  int emitted;
+} tbdd_entry_t;
+
+typedef struct
+{
+  tbdd_entry_t *entries;
+  size_t count;
+  size_t capacity;
+  uint32_t *index;
+  size_t nbuckets;
+  size_t *ephemerals;
+  size_t nephemerals;
+  size_t ephcap;
+  int64_t *closed;
+  size_t nclosed;
+  size_t closedcap;
+  tbdd_map_t *maps;
+  size_t nmaps;
+  size_t mapcap;
+  unsigned long replayed;
+} tbdd_overlay_t;
+
+typedef struct
+{
+  const char *prefix;
+  size_t prefixlen;
+  tb_snapshot_fn callback;
+  void *data;
+  char *buffer;
+  size_t bufsize;
+} tbdd_emit_t;
+
+static
+void *__tbdd_reserve(void *ptr, size_t *capacity, size_t count, size_t size)
+{
+  if (count < *capacity)
+  { return(ptr); }
+  size_t newcap = (*capacity == 0) ? 64 : *capacity * 2;
+  void *tmp     = realloc(ptr, newcap * size);
+  if (tmp != NULL)
+  { *capacity = newcap; }
+  return(tmp);
+}
+
+static
+uint64_t __tbdd_raw(tbdd_cursor_t *c, size_t n)
+{
+  uint64_t value = 0;
+  size_t k;
+  if (c->err || c->size - c->off < n)
+  {
+    c->err = 1;
+    return(0);
+  }
+  for (k=0; k<n; k+=1)
+  { value = (value << 8) | c->base[c->off + k]; }
+  c->off += n;
+  return(value);
+}
+
+static
+int32_t __tbdd_int(tbdd_cursor_t *c)
+{ return((int32_t) (uint32_t) __tbdd_raw(c, 4)); }
+
+static
+int64_t __tbdd_long(tbdd_cursor_t *c)
+{ return((int64_t) __tbdd_raw(c, 8)); }
+
+static
+const char *__tbdd_buffer(tbdd_cursor_t *c, int32_t *len)
+{
+  const char *ptr;
+  *len = __tbdd_int(c);
+  if (c->err || *len < 0 || c->size - c->off < (size_t) *len)
+  {
+    c->err = c->err || *len >= 0;
+    *len   = -1;
+    return(NULL);
+  }
+  ptr     = (const char *) c->base + c->off;
+  c->off += (size_t) *len;
+  return(ptr);
+}
+
+static
+void __tbdd_skipacl(tbdd_cursor_t *c)
+{
+  int32_t k, len;
+  int32_t n = __tbdd_int(c);
+  for (k=0; k<n && ! c->err; k+=1)
+  {
+    __tbdd_int(c);
+    __tbdd_buffer(c, &len);
+    __tbdd_buffer(c, &len);
+  }
+}
+
+static
+uint32_t __tbdd_adler32(const unsigned char *p, size_t n)
+{
+  uint32_t a = 1, b = 0;
+  size_t k;
+  for (k=0; k<n; k+=1)
+  {
+    a = (a + p[k]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return((b << 16) | a);
+}
+
+static
+int __tbdd_map(const char *dir, const char *name, tbdd_map_t *m)
+{
+  struct stat st;
+  char *file = tbh_join(dir, "/", name, NULL);
+  int fd     = (file == NULL) ? -1 : open(file, O_RDONLY);
+  free(file);
+  if (fd == -1)
+  { return(-1); }
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    close(fd);
+    return(-1);
+  }
+
+  // files are read once, front to back
+  m->size = (size_t) st.st_size;
+  m->addr = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m->addr == MAP_FAILED)
+  {
+    m->addr = NULL;
+    return(-1);
+  }
+  posix_madvise(m->addr, m->size, POSIX_MADV_SEQUENTIAL);
+  return(0);
+}
+
+static
+void __tbdd_unmap(tbdd_map_t *m)
+{
+  if (m->addr != NULL)
+  { munmap(m->addr, m->size); }
+  m->addr = NULL;
+}
+
+static
+int __tbdd_cmpfile(const void *a, const void *b)
+{
+  int64_t za = ((const tbdd_file_t *) a)->zxid;
+  int64_t zb = ((const tbdd_file_t *) b)->zxid;
+  return((za > zb) - (za < zb));
+}
+
+static
+void __tbdd_freelist(tbdd_file_t *files, size_t count)
+{
+  size_t k;
+  for (k=0; k<count; k+=1)
+  { free(files[k].name); }
+  free(files);
+}
+
+/* Lists the files named prefix + zxid (in hex), sorted by zxid. */
+static
+int __tbdd_list(const char *dir, const char *prefix, tbdd_file_t **files, size_t *count)
+{
+  struct dirent *de;
+  size_t capacity = 0;
+  size_t plen     = strlen(prefix);
+  int rc          = 0;
+  DIR *dh         = opendir(dir);
+  if (dh == NULL)
+  { return(-1); }
+
+  while (rc == 0 && (de = readdir(dh)) != NULL)
+  {
+    char *end;
+    if (strncmp(de->d_name, prefix, plen) != 0)
+    { continue; }
+    int64_t zxid = (int64_t) strtoull(de->d_name + plen, &end, 16);
+    if (end == de->d_name + plen || end[0] != '\0')
+    {
+      TB_DEBUG("ignoring file (compressed?): %s/%s", dir, de->d_name);
+      continue;
+    }
+
+    tbdd_file_t *tmp = (tbdd_file_t *) __tbdd_reserve(*files, &capacity, *count, sizeof(tbdd_file_t));
+    if (tmp == NULL)
+    { rc = -1; }
+    else
+    {
+      *files               = tmp;
+      (*files)[*count].zxid = zxid;
+      (*files)[*count].name = tbh_strdup(de->d_name);
+      if ((*files)[*count].name == NULL)
+      { rc = -1; }
+      else
+      { *count += 1; }
+    }
+  }
+  closedir(dh);
+
+  if (*count > 0)
+  { qsort(*files, *count, sizeof(tbdd_file_t), __tbdd_cmpfile); }
+  return(rc);
+}
+
+static
+uint32_t __tbdd_hash(const char *path, size_t len)
+{
+  uint32_t hash = 2166136261u;
+  size_t k;
+  for (k=0; k<len; k+=1)
+  {
+    hash ^= (unsigned char) path[k];
+    hash *= 16777619u;
+  }
+  return(hash);
+}
+
+static
+tbdd_entry_t *__tbdd_find(tbdd_overlay_t *ov, const char *path, size_t len)
+{
+  size_t slot;
+  if (ov->nbuckets == 0)
+  { return(NULL); }
+
+  for (slot = __tbdd_hash(path, len) & (ov->nbuckets - 1); ov->index[slot] != 0; slot = (slot + 1) & (ov->nbuckets - 1))
+  {
+    tbdd_entry_t *e = &ov->entries[ov->index[slot] - 1];
+    if (e->pathlen == len && memcmp(e->path, path, len) == 0)
+    { return(e); }
+  }
+  return(NULL);
+}
+
+static
+void __tbdd_insert(tbdd_overlay_t *ov, size_t k)
+{
+  tbdd_entry_t *e = &ov->entries[k];
+  size_t slot     = __tbdd_hash(e->path, e->pathlen) & (ov->nbuckets - 1);
+  while (ov->index[slot] != 0)
+  { slot = (slot + 1) & (ov->nbuckets - 1); }
+  ov->index[slot] = (uint32_t) (k + 1);
+}
+
+/* Finds a node or adds it as inherited from the snapshot. */
+static
+tbdd_entry_t *__tbdd_entry(tbdd_overlay_t *ov, const char *path, size_t len)
+{
+  size_t k;
+  tbdd_entry_t *e = __tbdd_find(ov, path, len);
+  if (e != NULL)
+  { return(e); }
+
+  if ((ov->count + 1) * 2 > ov->nbuckets)
+  {
+    size_t nbuckets = (ov->nbuckets == 0) ? 1024 : ov->nbuckets * 2;
+    uint32_t *index = (uint32_t *) calloc(nbuckets, sizeof(uint32_t));
+    if (index == NULL || ov->count >= UINT32_MAX)
+    {
+      free(index);
+      return(NULL);
+    }
+    free(ov->index);
+    ov->index    = index;
+    ov->nbuckets = nbuckets;
+    for (k=0; k<ov->count; k+=1)
+    { __tbdd_insert(ov, k); }
+  }
+
+  tbdd_entry_t *tmp = (tbdd_entry_t *) __tbdd_reserve(ov->entries, &ov->capacity, ov->count, sizeof(tbdd_entry_t));
+  if (tmp == NULL)
+  { return(NULL); }
+  ov->entries = tmp;
+
+  e = &ov->entries[ov->count];
+  memset(e, 0, sizeof(tbdd_entry_t));
+  e->path    = path;
+  e->pathlen = len;
+  e->datalen = -1;
+  e->exists  = 1;
+  __tbdd_insert(ov, ov->count);
+  ov->count += 1;
+  return(e);
+}
+
+static
+int __tbdd_create(tbdd_overlay_t *ov, const char *path, int32_t pathlen, const char *data, int32_t datalen, int64_t owner)
+{
+  tbdd_entry_t *e = __tbdd_entry(ov, path, (size_t) pathlen);
+  if (e == NULL)
+  { return(-1); }
+  e->created = 1;
+  e->exists  = 1;
+  e->hasdata = 1;
+  e->data    = data;
+  e->datalen = datalen;
+  e->owner   = owner;
+
+  if (owner != 0)
+  {
+    size_t *tmp = (size_t *) __tbdd_reserve(ov->ephemerals, &ov->ephcap, ov->nephemerals, sizeof(size_t));
+    if (tmp == NULL)
+    { return(-1); }
+    ov->ephemerals = tmp;
+    ov->ephemerals[ov->nephemerals++] = (size_t) (e - ov->entries);
+  }
+  return(0);
+}
+
+/* Removes the ephemerals created by the session in the logs. The ones
+ * in the snapshot are checked against ov->closed as it gets read. */
+static
+int __tbdd_close(tbdd_overlay_t *ov, int64_t session)
+{
+  size_t k, n = 0;
+  int64_t *tmp = (int64_t *) __tbdd_reserve(ov->closed, &ov->closedcap, ov->nclosed, sizeof(int64_t));
+  if (tmp == NULL)
+  { return(-1); }
+  ov->closed = tmp;
+  ov->closed[ov->nclosed++] = session;
+
+  for (k=0; k<ov->nephemerals; k+=1)
+  {
+    tbdd_entry_t *e = &ov->entries[ov->ephemerals[k]];
+    if (! e->exists || e->owner == 0)
+    { continue; }
+    if (e->owner == session)
+    { e->exists = 0; }
+    else
+    { ov->ephemerals[n++] = ov->ephemerals[k]; }
+  }
+  ov->nephemerals = n;
+  return(0);
+}
+
+static
+int __tbdd_apply(tbdd_overlay_t *ov, int32_t type, int64_t session, tbdd_cursor_t *c)
+{
+  const char *path, *data;
+  int32_t pathlen, datalen, k, n;
+  tbdd_entry_t *e;
+  int ephemeral = 0;
+
+  switch (type)
+  {
+  case TBDD_OP_CREATE:
+  case TBDD_OP_CREATE2:
+  case TBDD_OP_CREATECONTAINER:
+  case TBDD_OP_CREATETTL:
+    path = __tbdd_buffer(c, &pathlen);
+    data = __tbdd_buffer(c, &datalen);
+    __tbdd_skipacl(c);
+    if (type == TBDD_OP_CREATE || type == TBDD_OP_CREATE2)
+    { ephemeral = (__tbdd_raw(c, 1) != 0); }
+    if (c->err || path == NULL)
+    { return(-1); }
+    return(__tbdd_create(ov, path, pathlen, data, datalen, ephemeral ? session : 0));
+
+  case TBDD_OP_DELETE:
+  case TBDD_OP_DELETECONTAINER:
+    path = __tbdd_buffer(c, &pathlen);
+    if (path == NULL || (e = __tbdd_entry(ov, path, (size_t) pathlen)) == NULL)
+    { return(-1); }
+    e->exists = 0;
+    return(0);
+
+  case TBDD_OP_SETDATA:
+    path = __tbdd_buffer(c, &pathlen);
+    data = __tbdd_buffer(c, &datalen);
+    if (c->err || path == NULL || (e = __tbdd_entry(ov, path, (size_t) pathlen)) == NULL)
+    { return(-1); }
+    e->hasdata = 1;
+    e->data    = data;
+    e->datalen = datalen;
+    return(0);
+
+  case TBDD_OP_CLOSESESSION:
+    return(__tbdd_close(ov, session));
+
+  case TBDD_OP_MULTI:
+    n = __tbdd_int(c);
+    for (k=0; k<n && ! c->err; k+=1)
+    {
+      tbdd_cursor_t sub;
+      int32_t subtype = __tbdd_int(c);
+      int32_t sublen;
+      sub.base = (const unsigned char *) __tbdd_buffer(c, &sublen);
+      sub.size = (sublen < 0) ? 0 : (size_t) sublen;
+      sub.off  = 0;
+      sub.err  = 0;
+      if (c->err || __tbdd_apply(ov, subtype, session, &sub) != 0)
+      { return(-1); }
+    }
+    return(c->err ? -1 : 0);
+
+  default:
+    return(0);
+  }
+}
+
+/* Applies the transactions of a log after the from zxid.
+ *
+ * \return 0: end of the log;
+ *
+ * \return 1: the to zxid has been reached;
+ *
+ * \return -1: error;
+ */
+static
+int __tbdd_replay(tbdd_overlay_t *ov, const tbdd_map_t *m, const char *name, int64_t from, int64_t to)
+{
+  tbdd_cursor_t c;
+  int32_t len;
+  c.base = (const unsigned char *) m->addr;
+  c.size = m->size;
+  c.off  = 0;
+  c.err  = 0;
+
+  if (__tbdd_int(&c) != TBDD_LOG_MAGIC)
+  {
+    TB_DEBUG("not a transaction log: %s", name);
+    return(-1);
+  }
+  __tbdd_int(&c);
+  __tbdd_long(&c);
+
+  // logs are preallocated (with zeros) and the last record may be
+  // partially written
+  while (! c.err)
+  {
+    uint64_t crc    = (uint64_t) __tbdd_long(&c);
+    const char *txn = __tbdd_buffer(&c, &len);
+    if (txn == NULL || len == 0)
+    { break; }
+    if (__tbdd_adler32((const unsigned char *) txn, (size_t) len) != crc || __tbdd_raw(&c, 1) != 'B')
+    {
+      TB_DEBUG("truncated transaction log: %s", name);
+      break;
+    }
+
+    tbdd_cursor_t t;
+    t.base = (const unsigned char *) txn;
+    t.size = (size_t) len;
+    t.off  = 0;
+    t.err  = 0;
+    int64_t session = __tbdd_long(&t);
+    __tbdd_int(&t);
+    int64_t zxid    = __tbdd_long(&t);
+    __tbdd_long(&t);
+    int32_t type    = __tbdd_int(&t);
+    if (t.err)
+    { return(-1); }
+    if (zxid <= from)
+    { continue; }
+    if (to >= 0 && zxid > to)
+    { return(1); }
+    if (__tbdd_apply(ov, type, session, &t) != 0)
+    {
+      TB_DEBUG("error replaying transaction 0x%llx: %s", (unsigned long long) zxid, name);
+      return(-1);
+    }
+    ov->replayed += 1;
+  }
+  return(0);
+}
+
+static
+int __tbdd_logs(tbdd_overlay_t *ov, const char *dir, const tbdd_file_t *logs, size_t nlogs, int64_t from, int64_t to)
+{
+  size_t k, first = 0;
+  int rc = 0;
+
+  // the log holding the first transaction after the snapshot
+  for (k=0; k<nlogs; k+=1)
+  {
+    if (logs[k].zxid <= from)
+    { first = k; }
+  }
+  if (nlogs > 0 && logs[first].zxid > from + 1)
+  { TB_DEBUG("transaction logs missing after 0x%llx: %s", (unsigned long long) from, dir); }
+
+  for (k=first; rc == 0 && k<nlogs; k+=1)
+  {
+    if (to >= 0 && logs[k].zxid > to)
+    { break; }
+
+    tbdd_map_t *tmp = (tbdd_map_t *) __tbdd_reserve(ov->maps, &ov->mapcap, ov->nmaps, sizeof(tbdd_map_t));
+    if (tmp == NULL)
+    { return(-1); }
+    ov->maps = tmp;
+    if (__tbdd_map(dir, logs[k].name, &ov->maps[ov->nmaps]) != 0)
+    {
+      TB_DEBUG("could not read file: %s/%s", dir, logs[k].name);
+      return(-1);
+    }
+    ov->nmaps += 1;
+    rc = __tbdd_replay(ov, &ov->maps[ov->nmaps - 1], logs[k].name, from, to);
+  }
+  return((rc == -1) ? -1 : 0);
+}
+
+static
+int __tbdd_cmpsession(const void *a, const void *b)
+{
+  int64_t sa = *((const int64_t *) a);
+  int64_t sb = *((const int64_t *) b);
+  return((sa > sb) - (sa < sb));
+}
+
+static
+int __tbdd_closed(tbdd_overlay_t *ov, int64_t session)
+{ return(ov->nclosed > 0 && bsearch(&session, ov->closed, ov->nclosed, sizeof(int64_t), __tbdd_cmpsession) != NULL); }
+
+static
+int __tbdd_under(const tbdd_emit_t *em, const char *path, size_t len)
+{
+  return(len >= em->prefixlen
+         && memcmp(path, em->prefix, em->prefixlen) == 0
+         && (len == em->prefixlen || path[em->prefixlen] == '/'));
+}
+
+/* Splits the path (the root being "") into ppath and name. */
+static
+int __tbdd_emit(tbdd_emit_t *em, const char *path, size_t len, const char *data, int32_t datalen)
+{
+  char *name;
+  if (tbh_grow(&em->buffer, &em->bufsize, len + 1, 256, SIZE_MAX) != 0)
+  { return(-1); }
+  memcpy(em->buffer, path, len);
+  em->buffer[len] = '\0';
+
+  name = strrchr(em->buffer, '/');
+  if (name == NULL)
+  { name = em->buffer + len; }
+  else
+  { *name++ = '\0'; }
+  return(em->callback(ITEM, em->buffer, name, (datalen < 0) ? NULL : data, (datalen < 0) ? 0 : (size_t) datalen, NULL, em->data));
+}
+
+/* A snapshot is complete if it ends with the "/" path. */
+static
+int __tbdd_valid(const tbdd_map_t *m)
+{
+  static const unsigned char tail[] = { 0, 0, 0, 1, '/' };
+  return(m->size >= 16 + sizeof(tail) && memcmp((const char *) m->addr + m->size - sizeof(tail), tail, sizeof(tail)) == 0);
+}
+
+/* Reads the nodes of the snapshot (parents come before their
+ * children), as changed by the logs. */
+static
+int __tbdd_stream(tbdd_overlay_t *ov, tbdd_emit_t *em, const tbdd_map_t *m)
+{
+  tbdd_cursor_t c;
+  int32_t k, n, pathlen, datalen;
+  c.base = (const unsigned char *) m->addr;
+  c.size = m->size;
+  c.off  = 0;
+  c.err  = 0;
+
+  if (__tbdd_int(&c) != TBDD_SNAP_MAGIC)
+  { return(-1); }
+  __tbdd_int(&c);
+  __tbdd_long(&c);
+
+  // sessions and acls
+  n = __tbdd_int(&c);
+  for (k=0; k<n && ! c.err; k+=1)
+  {
+    __tbdd_long(&c);
+    __tbdd_int(&c);
+  }
+  n = __tbdd_int(&c);
+  for (k=0; k<n && ! c.err; k+=1)
+  {
+    __tbdd_long(&c);
+    __tbdd_skipacl(&c);
+  }
+
+  while (! c.err)
+  {
+    const char *path = __tbdd_buffer(&c, &pathlen);
+    if (path == NULL)
+    { break; }
+    if (pathlen == 1 && path[0] == '/')
+    { return(0); }
+
+    // data, acl and stat (of which only the ephemeral owner matters)
+    const char *data = __tbdd_buffer(&c, &datalen);
+    __tbdd_raw(&c, 8);
+    __tbdd_raw(&c, 8);
+    __tbdd_raw(&c, 8);
+    __tbdd_raw(&c, 8);
+    __tbdd_raw(&c, 8);
+    __tbdd_raw(&c, 4);
+    __tbdd_raw(&c, 4);
+    __tbdd_raw(&c, 4);
+    int64_t owner = __tbdd_long(&c);
+    __tbdd_raw(&c, 8);
+    if (c.err)
+    { break; }
+    if (! __tbdd_under(em, path, (size_t) pathlen))
+    { continue; }
+
+    tbdd_entry_t *e = __tbdd_find(ov, path, (size_t) pathlen);
+    if (e != NULL && e->created)
+    { e->emitted = 1; }
+    if ((e != NULL && ! e->exists) || ((e == NULL || ! e->created) && owner != 0 && __tbdd_closed(ov, owner)))
+    { continue; }
+    if (e != NULL && e->hasdata)
+    {
+      data    = e->data;
+      datalen = e->datalen;
+    }
+    if (__tbdd_emit(em, path, (size_t) pathlen, data, datalen) != 0)
+    { return(-1); }
+  }
+
+  TB_DEBUG0("corrupted snapshot");
+  return(-1);
+}
+
+typedef struct
+{
+  size_t depth;
+  size_t entry;
+} tbdd_order_t;
+
+static
+int __tbdd_cmpdepth(const void *a, const void *b)
+{
+  const tbdd_order_t *oa = (const tbdd_order_t *) a;
+  const tbdd_order_t *ob = (const tbdd_order_t *) b;
+  if (oa->depth != ob->depth)
+  { return((oa->depth > ob->depth) - (oa->depth < ob->depth)); }
+  return((oa->entry > ob->entry) - (oa->entry < ob->entry));
+}
+
+/* The nodes created by the logs which the snapshot did not have,
+ * parents first. */
+static
+int __tbdd_rest(tbdd_overlay_t *ov, tbdd_emit_t *em)
+{
+  size_t j, k, n = 0;
+  int rc = 0;
+  tbdd_order_t *order = (tbdd_order_t *) malloc(sizeof(tbdd_order_t) * (ov->count + 1));
+  if (order == NULL)
+  { return(-1); }
+
+  for (k=0; k<ov->count; k+=1)
+  {
+    tbdd_entry_t *e = &ov->entries[k];
+    if (e->created && e->exists && ! e->emitted && __tbdd_under(em, e->path, e->pathlen))
+    {
+      order[n].depth = 0;
+      order[n].entry = k;
+      for (j=0; j<e->pathlen; j+=1)
+      { order[n].depth += (e->path[j] == '/'); }
+      n += 1;
+    }
+  }
+  qsort(order, n, sizeof(tbdd_order_t), __tbdd_cmpdepth);
+
+  for (k=0; rc == 0 && k<n; k+=1)
+  {
+    tbdd_entry_t *e = &ov->entries[order[k].entry];
+    rc = __tbdd_emit(em, e->path, e->pathlen, e->data, e->datalen);
+  }
+  free(order);
+  return(rc);
+}
+
+int tractorbeam_datadir_snapshot(const char *dir, const char *path, int64_t zxid, tb_snapshot_fn callback, void *data)
+{
+  tbdd_overlay_t ov;
+  tbdd_emit_t em;
+  tbdd_map_t snap;
+  tbdd_file_t *snaps = NULL;
+  tbdd_file_t *logs  = NULL;
+  size_t k, nsnaps = 0, nlogs = 0;
+  int rc = -1;
+
+  memset(&ov, 0, sizeof(ov));
+  memset(&em, 0, sizeof(em));
+  snap.addr    = NULL;
+  em.prefix    = path;
+  em.prefixlen = strlen(path);
+  em.callback  = callback;
+  em.data      = data;
+  while (em.prefixlen > 0 && path[em.prefixlen - 1] == '/')
+  { em.prefixlen -= 1; }
+
+  if (__tbdd_list(dir, "snapshot.", &snaps, &nsnaps) != 0 || __tbdd_list(dir, "log.", &logs, &nlogs) != 0)
+  { TB_DEBUG("could not read directory: %s", dir); }
+  else
+  {
+    // the latest complete snapshot (the server may be writing one)
+    for (k=nsnaps; k>0; k-=1)
+    {
+      if ((zxid >= 0 && snaps[k-1].zxid > zxid) || __tbdd_map(dir, snaps[k-1].name, &snap) != 0)
+      { continue; }
+      if (__tbdd_valid(&snap))
+      { break; }
+      TB_DEBUG("ignoring incomplete snapshot: %s/%s", dir, snaps[k-1].name);
+      __tbdd_unmap(&snap);
+    }
+
+    if (k == 0)
+    { TB_DEBUG("no snapshot found: %s", dir); }
+    else if (__tbdd_logs(&ov, dir, logs, nlogs, snaps[k-1].zxid, zxid) == 0)
+    {
+      TB_DEBUG("reading %s/%s (and %lu transactions)", dir, snaps[k-1].name, ov.replayed);
+      if (ov.nclosed > 0)
+      { qsort(ov.closed, ov.nclosed, sizeof(int64_t), __tbdd_cmpsession); }
+      rc = __tbdd_stream(&ov, &em, &snap);
+      if (rc == 0)
+      { rc = __tbdd_rest(&ov, &em); }
+    }
+  }
+
+  int status = callback((rc == 0) ? DONE : FAIL, path, "", NULL, 0, NULL, data);
+
+  __tbdd_unmap(&snap);
+  for (k=0; k<ov.nmaps; k+=1)
+  { __tbdd_unmap(&ov.maps[k]); }
+  free(ov.maps);
+  free(ov.entries);
+  free(ov.index);
+  free(ov.ephemerals);
+  free(ov.closed);
+  free(em.buffer);
+  __tbdd_freelist(snaps, nsnaps);
+  __tbdd_freelist(logs, nlogs);
+  return(status);
+}
@@ -0,0 +1,55 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_datadir_h__
+#define __tractorbeam_datadir_h__
+
+#include <stdint.h>
+#include "tractorbeam/monitor.h"
+
+/*! Reads a tree out of the files of a zookeeper server (the
+ *  version-2 directory of its dataDir), instead of a live ensemble.
+ *
+ * The latest valid snapshot is streamed from disk (it is mapped, not
+ * loaded) and the transaction logs are replayed on top of it. Only
+ * the nodes the logs touch are kept in memory.
+ *
+ * \param dir The directory with the snapshot.* and log.* files;
+ *
+ * \param path The tree you want to read;
+ *
+ * \param zxid Stops replaying the logs after this transaction (older
+ *             snapshots are used if necessary). -1 replays them all;
+ *
+ * \param callback As in tractorbeam_monitor_snapshot (nodes come
+ *                 after their parents);
+ *
+ * \return The return of the last callback call;
+ */
+int tractorbeam_datadir_snapshot(const char *dir, const char *path, int64_t zxid, tb_snapshot_fn callback, void *data);
+
+#endif
@@ -0,0 +1,321 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/digest.h"
+#include "tractorbeam/helpers.h"
+
+#define TBDG_M 0xc6a4a7935bd1e995ULL
+
+/* The nodes whose subtrees are still being read. Their paths are
+ * prefixes of each other, so they share a single buffer. */
+typedef struct
+{
+  size_t pathlen;
+  uint64_t state;
+  uint64_t nchildren;
+} tbdg_frame_t;
+
+struct tractorbeam_digest_t
+{
+  FILE *out;
+  tb_snapshot_fn callback;
+  void *data;
+  char *path;
+  size_t pathsize;
+  tbdg_frame_t *stack;
+  size_t depth;
+  size_t capacity;
+  int visited;
+};
+
+typedef struct
+{
+  FILE *file;
+  char *line;
+  size_t linesize;
+  const char *path;
+  uint64_t digest;
+  int ok;
+} tbdg_reader_t;
+
+static
+uint64_t __tbdg_mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return(h);
+}
+
+/* MurmurHash64A, which consumes 8 bytes at a time. Words are read in
+ * little endian so that digests do not depend on the host. */
+static
+uint64_t __tbdg_hash(const void *ptr, size_t len, uint64_t seed)
+{
+  const unsigned char *p = (const unsigned char *) ptr;
+  uint64_t h = seed ^ (len * TBDG_M);
+  uint64_t k;
+  size_t j;
+
+  for (; len >= 8; p += 8, len -= 8)
+  {
+    k = (uint64_t) p[0]         | ((uint64_t) p[1] << 8)
+      | ((uint64_t) p[2] << 16) | ((uint64_t) p[3] << 24)
+      | ((uint64_t) p[4] << 32) | ((uint64_t) p[5] << 40)
+      | ((uint64_t) p[6] << 48) | ((uint64_t) p[7] << 56);
+    k *= TBDG_M;
+    k ^= k >> 47;
+    k *= TBDG_M;
+    h ^= k;
+    h *= TBDG_M;
+  }
+  if (len > 0)
+  {
+    for (k=0, j=len; j>0; j-=1)
+    { k = (k << 8) | p[j-1]; }
+    h ^= k;
+    h *= TBDG_M;
+  }
+
+  h ^= h >> 47;
+  h *= TBDG_M;
+  h ^= h >> 47;
+  return(h);
+}
+
+/* Children are folded in the order they come (sorted), so the
+ * digest depends on it. */
+static
+uint64_t __tbdg_fold(uint64_t state, uint64_t digest)
+{ return(__tbdg_mix((state * TBDG_M) ^ digest)); }
+
+static
+int __tbdg_pop(tractorbeam_digest_t *d)
+{
+  tbdg_frame_t *frame = &d->stack[d->depth - 1];
+  uint64_t digest     = __tbdg_mix(frame->state ^ (frame->nchildren * TBDG_M));
+
+  d->path[frame->pathlen] = '\0';
+  if (fprintf(d->out, "%016llx %s\n", (unsigned long long) digest, (frame->pathlen == 0) ? "/" : d->path) < 0)
+  { return(-1); }
+
+  d->depth -= 1;
+  if (d->depth > 0)
+  {
+    frame             = &d->stack[d->depth - 1];
+    frame->state      = __tbdg_fold(frame->state, digest);
+    frame->nchildren += 1;
+  }
+  return(0);
+}
+
+static
+int __tbdg_push(tractorbeam_digest_t *d, const char *ppath, const char *name, const void *contents, size_t contsize)
+{
+  size_t plen = strlen(ppath);
+  size_t nlen = strlen(name);
+
+  if (tbh_grow(&d->path, &d->pathsize, plen + nlen + 2, 256, (size_t) -1) != 0)
+  { return(-1); }
+  if (d->depth == d->capacity)
+  {
+    size_t capacity    = (d->capacity == 0) ? 32 : d->capacity * 2;
+    tbdg_frame_t *tmp = (tbdg_frame_t *) realloc(d->stack, sizeof(tbdg_frame_t) * capacity);
+    if (tmp == NULL)
+    { return(-1); }
+    d->stack    = tmp;
+    d->capacity = capacity;
+  }
+
+  // the root ("/") is the ppath of its children: ""
+  tbdg_frame_t *frame = &d->stack[d->depth++];
+  frame->pathlen      = (plen + nlen == 0) ? 0 : plen + nlen + 1;
+  frame->state        = __tbdg_hash(contents, contsize, __tbdg_hash(name, nlen, 0));
+  frame->nchildren    = 0;
+  memcpy(d->path, ppath, plen);
+  d->path[plen] = '/';
+  memcpy(d->path + plen + 1, name, nlen);
+  return(0);
+}
+
+tractorbeam_digest_t *tractorbeam_digest_init(FILE *out, tb_snapshot_fn callback, void *data)
+{
+  tractorbeam_digest_t *d = (tractorbeam_digest_t *) malloc(sizeof(tractorbeam_digest_t));
+  if (d == NULL)
+  { return(NULL); }
+  memset(d, 0, sizeof(tractorbeam_digest_t));
+  d->out      = out;
+  d->callback = callback;
+  d->data     = data;
+  return(d);
+}
+
+int tractorbeam_digest_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  tractorbeam_digest_t *d = (tractorbeam_digest_t *) data;
+  if (event == ITEM)
+  {
+    size_t plen = strlen(ppath);
+
+    // closes the nodes (siblings and their subtrees) which are not
+    // ancestors of this one
+    while (d->depth > 0 && (d->stack[d->depth - 1].pathlen != plen || memcmp(d->path, ppath, plen) != 0))
+    {
+      if (__tbdg_pop(d) != 0)
+      { return(-1); }
+    }
+    if (d->depth == 0 && d->visited)
+    {
+      TB_DEBUG("tree not sorted: %s/%s", ppath, name);
+      return(-1);
+    }
+    d->visited = 1;
+
+    if (__tbdg_push(d, ppath, name, contents, contsize) != 0)
+    { return(-1); }
+  }
+  else if (event == DONE)
+  {
+    while (d->depth > 0)
+    {
+      if (__tbdg_pop(d) != 0)
+      { return(d->callback(FAIL, ppath, name, contents, contsize, stat, d->data)); }
+    }
+  }
+  return(d->callback(event, ppath, name, contents, contsize, stat, d->data));
+}
+
+void tractorbeam_digest_term(tractorbeam_digest_t *d)
+{
+  free(d->path);
+  free(d->stack);
+  free(d);
+}
+
+static
+int __tbdg_read(tbdg_reader_t *r)
+{
+  char *end;
+  ssize_t len = getline(&r->line, &r->linesize, r->file);
+  r->ok       = 0;
+  if (len == -1)
+  { return(ferror(r->file) ? -1 : 0); }
+
+  if (len > 0 && r->line[len - 1] == '\n')
+  { r->line[len - 1] = '\0'; }
+  r->digest = (uint64_t) strtoull(r->line, &end, 16);
+  if (end == r->line || end[0] != ' ')
+  {
+    TB_DEBUG0("corrupted digests file");
+    return(-1);
+  }
+  r->path = end + 1;
+  r->ok   = 1;
+  return(0);
+}
+
+/* The order digests are written: children before their parents and
+ * siblings in ascending order. */
+static
+int __tbdg_pathcmp(const char *a, const char *b)
+{
+  if (strcmp(a, "/") == 0)
+  { a = ""; }
+  if (strcmp(b, "/") == 0)
+  { b = ""; }
+  for (; a[0] != '\0' && a[0] == b[0]; a++, b++)
+  { }
+
+  if (a[0] == '\0' && b[0] == '/')
+  { return(1); }
+  if (b[0] == '\0' && a[0] == '/')
+  { return(-1); }
+  int ca = (a[0] == '\0') ? 0 : ((a[0] == '/') ? 1 : (unsigned char) a[0] + 1);
+  int cb = (b[0] == '\0') ? 0 : ((b[0] == '/') ? 1 : (unsigned char) b[0] + 1);
+  return(ca - cb);
+}
+
+int tractorbeam_digest_compare(FILE *a, FILE *b, FILE *out)
+{
+  tbdg_reader_t ra, rb;
+  int rc   = -1;
+  int diff = 0;
+
+  memset(&ra, 0, sizeof(ra));
+  memset(&rb, 0, sizeof(rb));
+  ra.file = a;
+  rb.file = b;
+  if (__tbdg_read(&ra) != 0 || __tbdg_read(&rb) != 0)
+  { goto handle_error; }
+
+  while (ra.ok || rb.ok)
+  {
+    int cmp = (! rb.ok) ? -1 : ((! ra.ok) ? 1 : __tbdg_pathcmp(ra.path, rb.path));
+    if (cmp < 0)
+    { fprintf(out, "-%s\n", ra.path); }
+    else if (cmp > 0)
+    { fprintf(out, "+%s\n", rb.path); }
+    else if (ra.digest != rb.digest)
+    { fprintf(out, "~%s\n", ra.path); }
+    diff = diff || cmp != 0 || ra.digest != rb.digest;
+
+    if ((cmp <= 0 && __tbdg_read(&ra) != 0) || (cmp >= 0 && __tbdg_read(&rb) != 0))
+    { goto handle_error; }
+  }
+  rc = diff;
+
+handle_error:
+  free(ra.line);
+  free(rb.line);
+  return(rc);
+}
+
+int tractorbeam_compare(tractorbeam_compare_t *info)
+{
+  int rc  = -1;
+  FILE *a = fopen(info->digests, "r");
+  FILE *b = fopen(info->against, "r");
+  if (a == NULL || b == NULL)
+  { TB_DEBUG("could not open files: %s, %s", info->digests, info->against); }
+  else
+  { rc = tractorbeam_digest_compare(a, b, stdout); }
+
+  if (a != NULL)
+  { fclose(a); }
+  if (b != NULL)
+  { fclose(b); }
+  return(rc);
+}
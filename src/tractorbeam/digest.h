@@ -0,0 +1,77 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_digest_h__
+#define __tractorbeam_digest_h__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "tractorbeam/monitor.h"
+
+typedef struct tractorbeam_digest_t tractorbeam_digest_t;
+
+typedef struct
+{
+  char *digests;
+  char *against;
+} tractorbeam_compare_t;
+
+/*! Computes a merkle digest for every node (its name and contents
+ *  along with the digests of its children) while a tree gets read.
+ *
+ * Use tractorbeam_digest_cc as the snapshot callback (with the
+ * handle as its data) and it forwards every event to the callback
+ * given here. The tree must be read in sorted order.
+ *
+ * \param out The file to write the digests into, one per line
+ *            (<DIGEST> " " <PATH>), children before their parents
+ *            (the root comes last);
+ */
+tractorbeam_digest_t *tractorbeam_digest_init(FILE *out, tb_snapshot_fn callback, void *data);
+
+int tractorbeam_digest_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data);
+
+void tractorbeam_digest_term(tractorbeam_digest_t *);
+
+/*! Compares two files written by tractorbeam_digest_cc, writing the
+ *  nodes whose digests differ ("~"), the ones only in a ("-") and the
+ *  ones only in b ("+"). Nodes of identical subtrees are left out.
+ *
+ * \return 0: the trees are identical;
+ *
+ * \return 1: the trees differ;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_digest_compare(FILE *a, FILE *b, FILE *out);
+
+/*! Compares two digest files, writing the differences into the
+ *  stdout (as tractorbeam_digest_compare).
+ */
+int tractorbeam_compare(tractorbeam_compare_t *);
+
+#endif
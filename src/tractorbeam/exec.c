@@ -37,11 +37,11 @@
 #include "tractorbeam/exec.h"
 #include "tractorbeam/debug.h"
 #include "tractorbeam/popen.h"
+#include "tractorbeam/helpers.h"
 
 static
-size_t __tbexec_read(int fd, int timeout_in_sec, char *out, size_t outsz)
+int __tbexec_read(int fd, int timeout_in_sec, char **out, size_t *outsz, size_t maxsz)
 {
-  char buffer[TRACTORBEAM_BUFFER_SIZE];
   fd_set r_set;
   size_t offset;
   struct timeval timeout;
@@ -50,49 +50,41 @@ size_t __tbexec_read(int fd, int timeout_in_sec, char *out, size_t outsz)
   timeout.tv_sec  = timeout_in_sec;
   timeout.tv_usec = 0;
 
-  FD_ZERO(&r_set);
-  FD_SET(fd, &r_set);
   while (1)
   {
+    FD_ZERO(&r_set);
+    FD_SET(fd, &r_set);
     int rc = select(fd+1, &r_set, NULL, NULL, &timeout);
     if (rc == -1)
-    { return(offset = -1); }
-
-    if (timeout.tv_sec <= 0)
+    { return(-1); }
+    else if (rc == 0)
     { return(-2); }
 
-    if (FD_ISSET(fd, &r_set))
-    {
-      size_t rc = read(fd, buffer, TRACTORBEAM_BUFFER_SIZE);
-      if (rc == 0)
-      { break; }
-      else if (rc == (size_t) -1)
-      { return(-1); }
-      else
-      {
-        if (outsz > rc)
-        {
-          memcpy(out+offset, buffer, rc);
-          outsz  -= rc;
-          offset += rc;
-        }
-        else
-        { return(-3); }
-      }
-    }
+    // maxsz + 1 lets a read past the limit tell larger outputs apart
+    if (offset == *outsz && tbh_grow(out, outsz, offset + 1, TRACTORBEAM_BUFFER_SIZE, maxsz + 1) != 0)
+    { return(-1); }
+
+    ssize_t r = read(fd, *out + offset, *outsz - offset);
+    if (r == 0)
+    { break; }
+    else if (r == -1)
+    { return(-1); }
+    offset += (size_t) r;
+    if (offset > maxsz)
+    { return(-3); }
   }
 
-  return(offset);
+  return((int) offset);
 }
 
-int tractorbeam_exec(const char *prg, char * const * argv, int timeout, int *estatus, void *out, size_t outsz)
+int tractorbeam_exec(const char *prg, char * const * argv, int timeout, int *estatus, char **out, size_t *outsz, size_t maxsz)
 {
   tractorbeam_popen_t *proc = tractorbeam_popen_init(prg, argv, NULL);
   if (proc == NULL)
   { return(-1) ; }
 
-  size_t offset = __tbexec_read(tractorbeam_popen_fd(proc), timeout, out, outsz);
+  int rc = __tbexec_read(tractorbeam_popen_fd(proc), timeout, out, outsz, maxsz);
 
   *estatus = tractorbeam_popen_term(proc, 1);
-  return((int) offset);
+  return(rc);
 }
@@ -28,6 +28,8 @@
 #ifndef __tractorbeam_exec_h__
 #define __tractorbeam_exec_h__
 
+#include <stdlib.h>
+
 #define TRACTORBEAM_BUFFER_SIZE 4096
 
 /*! Runs a program and collect its output.
@@ -42,19 +44,23 @@
  * 
  * \param ecode The exit code of the program;
  *
- * \param out The variable that will get the program output;
+ * \param out The buffer that gets the program output. It grows as
+ *            needed (realloc) and may be NULL initially;
+ *
+ * \param outsz The size of the out buffer, updated when it grows;
  *
- * \param outsz The size of the out param;
+ * \param maxsz The largest output accepted (the out buffer may grow
+ *              to maxsz + 1);
  *
- * \return >0 The program has successfully terminated (number of bytes read);
+ * \return >=0 The program has successfully terminated (number of bytes read);
  *
  * \return -1 The program has failed to start or there was an error
  *            reading the output;
  *
  * \return -2 The program has timed out;
  *
- * \return -3 Buffer was too small;
+ * \return -3 The output is larger than maxsz;
  */
-int tractorbeam_exec(const char *prg, char * const *argv, int timeout_in_sec, int *ecode, void *out, size_t outsz);
+int tractorbeam_exec(const char *prg, char * const *argv, int timeout_in_sec, int *ecode, char **out, size_t *outsz, size_t maxsz);
 
 #endif
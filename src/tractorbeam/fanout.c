@@ -0,0 +1,184 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <stdlib.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/fanout.h"
+#include "tractorbeam/helpers.h"
+
+#define TBF_DATA_MIN 4096
+
+struct tractorbeam_fanout_t
+{
+  char *data;
+  size_t datacap;
+  tractorbeam_fanout_entry_t *entries;
+  size_t count;
+  size_t cap;
+};
+
+static
+int __tbf_compare(const void *a, const void *b)
+{
+  const tractorbeam_fanout_entry_t *x = (const tractorbeam_fanout_entry_t *) a;
+  const tractorbeam_fanout_entry_t *y = (const tractorbeam_fanout_entry_t *) b;
+  int rc = strcmp(x->key, y->key);
+  if (rc != 0)
+  { return(rc); }
+  // same key: keeps the original order so that the last one wins
+  return((x->key > y->key) - (x->key < y->key));
+}
+
+static
+int __tbf_valid(const char *key)
+{
+  return(key[0] != '\0'
+         && strcmp(key, ".") != 0
+         && strcmp(key, "..") != 0
+         && strchr(key, '/') == NULL);
+}
+
+static
+int __tbf_push(tractorbeam_fanout_t *fh, const char *key, const char *value, size_t valsize)
+{
+  if (fh->count == fh->cap)
+  {
+    size_t cap = (fh->cap == 0) ? 16 : fh->cap * 2;
+    tractorbeam_fanout_entry_t *tmp = (tractorbeam_fanout_entry_t *) realloc(fh->entries, sizeof(tractorbeam_fanout_entry_t) * cap);
+    if (tmp == NULL)
+    { return(-1); }
+    fh->entries = tmp;
+    fh->cap     = cap;
+  }
+
+  fh->entries[fh->count].key     = key;
+  fh->entries[fh->count].value   = value;
+  fh->entries[fh->count].valsize = valsize;
+  fh->count += 1;
+  return(0);
+}
+
+tractorbeam_fanout_t *tractorbeam_fanout_init(void)
+{
+  tractorbeam_fanout_t *fh = (tractorbeam_fanout_t *) malloc(sizeof(tractorbeam_fanout_t));
+  if (fh != NULL)
+  {
+    fh->data    = NULL;
+    fh->datacap = 0;
+    fh->entries = NULL;
+    fh->count   = 0;
+    fh->cap     = 0;
+  }
+  return(fh);
+}
+
+int tractorbeam_fanout_parse(tractorbeam_fanout_t *fh, const char *data, size_t datasize)
+{
+  fh->count = 0;
+  if (tbh_grow(&fh->data, &fh->datacap, datasize + 1, TBF_DATA_MIN, (size_t) -1) != 0)
+  { return(-1); }
+  memcpy(fh->data, data, datasize);
+  fh->data[datasize] = '\0';
+
+  // keys and values point into the copy, with '=' and '\n' replaced by '\0'
+  char *line = fh->data;
+  char *end  = fh->data + datasize;
+  while (line < end)
+  {
+    char *eol = (char *) memchr(line, '\n', end - line);
+    if (eol == NULL)
+    { eol = end; }
+    *eol = '\0';
+
+    char *sep = (char *) memchr(line, '=', eol - line);
+    if (sep == NULL)
+    { TB_DEBUG("ignoring line (no `='): %s", line); }
+    else
+    {
+      *sep = '\0';
+      if (! __tbf_valid(line) || strlen(line) != (size_t) (sep - line))
+      { TB_DEBUG("ignoring invalid key: %s", line); }
+      else if (__tbf_push(fh, line, sep + 1, eol - sep - 1) != 0)
+      {
+        fh->count = 0;
+        return(-1);
+      }
+    }
+    line = eol + 1;
+  }
+
+  qsort(fh->entries, fh->count, sizeof(tractorbeam_fanout_entry_t), __tbf_compare);
+
+  size_t k, w = 0;
+  for (k=0; k<fh->count; k+=1)
+  {
+    if (w > 0 && strcmp(fh->entries[w-1].key, fh->entries[k].key) == 0)
+    { fh->entries[w-1] = fh->entries[k]; }
+    else
+    { fh->entries[w++] = fh->entries[k]; }
+  }
+  fh->count = w;
+
+  return(0);
+}
+
+void tractorbeam_fanout_clear(tractorbeam_fanout_t *fh)
+{ fh->count = 0; }
+
+size_t tractorbeam_fanout_count(const tractorbeam_fanout_t *fh)
+{ return(fh->count); }
+
+const tractorbeam_fanout_entry_t *tractorbeam_fanout_entry(const tractorbeam_fanout_t *fh, size_t k)
+{ return(k < fh->count ? &fh->entries[k] : NULL); }
+
+const tractorbeam_fanout_entry_t *tractorbeam_fanout_find(const tractorbeam_fanout_t *fh, const char *key)
+{
+  size_t lo = 0, hi = fh->count;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    int rc     = strcmp(key, fh->entries[mid].key);
+    if (rc == 0)
+    { return(&fh->entries[mid]); }
+    else if (rc < 0)
+    { hi = mid; }
+    else
+    { lo = mid + 1; }
+  }
+  return(NULL);
+}
+
+void tractorbeam_fanout_term(tractorbeam_fanout_t *fh)
+{
+  if (fh != NULL)
+  {
+    free(fh->data);
+    free(fh->entries);
+    free(fh);
+  }
+}
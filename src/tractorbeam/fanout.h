@@ -0,0 +1,80 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_fanout_h__
+#define __tractorbeam_fanout_h__
+
+#include <stdlib.h>
+
+typedef struct
+{
+  const char *key;
+  const char *value;
+  size_t valsize;
+} tractorbeam_fanout_entry_t;
+
+typedef struct tractorbeam_fanout_t tractorbeam_fanout_t;
+
+/*! Creates an empty set of key/value entries.
+ *
+ * \return The handle or NULL if there was any error;
+ */
+tractorbeam_fanout_t *tractorbeam_fanout_init(void);
+
+/*! Replaces the entries with the ones found in data.
+ *
+ * The data is made of `key=value` lines. Lines without a `=` and keys
+ * that are not valid znode names (empty, `.`, `..` or having a `/`)
+ * are ignored. When a key repeats the last value wins.
+ *
+ * \return 0: success;
+ *
+ * \return -1: error (the entries are left empty);
+ */
+int tractorbeam_fanout_parse(tractorbeam_fanout_t *, const char *data, size_t datasize);
+
+/*! Removes all entries.
+ */
+void tractorbeam_fanout_clear(tractorbeam_fanout_t *);
+
+/*! The number of entries.
+ */
+size_t tractorbeam_fanout_count(const tractorbeam_fanout_t *);
+
+/*! Returns the k-th entry (entries are sorted by key).
+ */
+const tractorbeam_fanout_entry_t *tractorbeam_fanout_entry(const tractorbeam_fanout_t *, size_t k);
+
+/*! Returns the entry of the given key or NULL if there is none.
+ */
+const tractorbeam_fanout_entry_t *tractorbeam_fanout_find(const tractorbeam_fanout_t *, const char *key);
+
+/*! Free all resources used by this handle.
+ */
+void tractorbeam_fanout_term(tractorbeam_fanout_t *);
+
+#endif
@@ -0,0 +1,209 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/filter.h"
+#include "tractorbeam/helpers.h"
+
+#define TBF_MATCH  1
+#define TBF_PREFIX 2
+
+typedef struct
+{
+  char *buffer;
+  const char **segments;
+  size_t count;
+} tbf_pattern_t;
+
+struct tractorbeam_filter_t
+{
+  tbf_pattern_t *includes;
+  size_t nincludes;
+  tbf_pattern_t *excludes;
+  size_t nexcludes;
+  int max_depth;
+};
+
+/* Splits the pattern into segments, in place. Empty segments are
+ * ignored, so / has none and matches the root node only. */
+static
+int __tbf_compile(tbf_pattern_t *p, const char *pattern)
+{
+  char *s;
+  if (pattern[0] != '/')
+  {
+    TB_DEBUG("pattern must be absolute: %s", pattern);
+    return(-1);
+  }
+
+  p->buffer   = tbh_strdup(pattern);
+  p->segments = (const char **) malloc(sizeof(char *) * (strlen(pattern) / 2 + 1));
+  p->count    = 0;
+  if (p->buffer == NULL || p->segments == NULL)
+  { return(-1); }
+
+  for (s=strtok(p->buffer, "/"); s != NULL; s=strtok(NULL, "/"))
+  { p->segments[p->count++] = s; }
+  return(0);
+}
+
+/* Matches a single segment (len bytes of str) against a glob. */
+static
+int __tbf_glob(const char *glob, const char *str, size_t len)
+{
+  const char *star = NULL;
+  size_t k         = 0;
+  size_t mark      = 0;
+
+  while (k < len)
+  {
+    if (glob[0] == '*')
+    {
+      star  = ++glob;
+      mark  = k;
+    }
+    else if (glob[0] != '\0' && (glob[0] == '?' || glob[0] == str[k]))
+    {
+      glob += 1;
+      k    += 1;
+    }
+    else if (star != NULL)
+    {
+      glob = star;
+      k    = ++mark;
+    }
+    else
+    { return(0); }
+  }
+  while (glob[0] == '*')
+  { glob += 1; }
+  return(glob[0] == '\0');
+}
+
+/* Matches the remaining of path ("" or "/seg...") against the
+ * segments of the pattern, starting at k. */
+static
+int __tbf_match(const tbf_pattern_t *p, size_t k, const char *path)
+{
+  int doublestar = (k < p->count && strcmp(p->segments[k], "**") == 0);
+  if (path[0] == '\0')
+  {
+    if (doublestar)
+    { return(TBF_PREFIX | __tbf_match(p, k + 1, path)); }
+    return((k == p->count) ? TBF_MATCH : TBF_PREFIX);
+  }
+  else if (k == p->count)
+  { return(0); }
+
+  const char *next = strchr(path + 1, '/');
+  if (next == NULL)
+  { next = path + strlen(path); }
+  if (doublestar)
+  { return(__tbf_match(p, k + 1, path) | __tbf_match(p, k, next)); }
+  if (! __tbf_glob(p->segments[k], path + 1, (size_t) (next - path - 1)))
+  { return(0); }
+  return(__tbf_match(p, k + 1, next));
+}
+
+static
+void __tbf_free(tbf_pattern_t *p, size_t count)
+{
+  for (size_t k=0; p != NULL && k<count; k+=1)
+  {
+    free(p[k].buffer);
+    free(p[k].segments);
+  }
+  free(p);
+}
+
+static
+tbf_pattern_t *__tbf_patterns(char * const *patterns, int count)
+{
+  tbf_pattern_t *p = (tbf_pattern_t *) calloc((size_t) count + 1, sizeof(tbf_pattern_t));
+  for (int k=0; p != NULL && k<count; k+=1)
+  {
+    if (__tbf_compile(&p[k], patterns[k]) != 0)
+    {
+      __tbf_free(p, (size_t) k + 1);
+      return(NULL);
+    }
+  }
+  return(p);
+}
+
+tractorbeam_filter_t *tractorbeam_filter_init(char * const *includes, int nincludes, char * const *excludes, int nexcludes, int max_depth)
+{
+  tractorbeam_filter_t *f = (tractorbeam_filter_t *) malloc(sizeof(tractorbeam_filter_t));
+  if (f == NULL)
+  { return(NULL); }
+
+  f->includes  = __tbf_patterns(includes, nincludes);
+  f->nincludes = (size_t) nincludes;
+  f->excludes  = __tbf_patterns(excludes, nexcludes);
+  f->nexcludes = (size_t) nexcludes;
+  f->max_depth = max_depth;
+  if (f->includes == NULL || f->excludes == NULL)
+  {
+    tractorbeam_filter_term(f);
+    return(NULL);
+  }
+  return(f);
+}
+
+int tractorbeam_filter_check(const tractorbeam_filter_t *f, const char *path, size_t depth)
+{
+  int list  = (f->nincludes == 0);
+  int fetch = (f->nincludes == 0);
+  if (strcmp(path, "/") == 0)
+  { path = ""; }
+
+  if (f->max_depth >= 0 && depth > (size_t) f->max_depth)
+  { return(0); }
+  for (size_t k=0; k<f->nexcludes; k+=1)
+  {
+    if (__tbf_match(&f->excludes[k], 0, path) & TBF_MATCH)
+    { return(0); }
+  }
+  for (size_t k=0; k<f->nincludes && ! (list && fetch); k+=1)
+  {
+    int rc = __tbf_match(&f->includes[k], 0, path);
+    list   = list || (rc & TBF_PREFIX);
+    fetch  = fetch || (rc & TBF_MATCH);
+  }
+
+  if (f->max_depth >= 0 && depth == (size_t) f->max_depth)
+  { list = 0; }
+  return((list ? TB_FILTER_LIST : 0) | (fetch ? TB_FILTER_FETCH : 0));
+}
+
+void tractorbeam_filter_term(tractorbeam_filter_t *f)
+{
+  __tbf_free(f->includes, f->nincludes);
+  __tbf_free(f->excludes, f->nexcludes);
+  free(f);
+}
@@ -0,0 +1,74 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_filter_h__
+#define __tractorbeam_filter_h__
+
+#include <stdlib.h>
+
+#define TB_FILTER_LIST  1
+#define TB_FILTER_FETCH 2
+
+typedef struct tractorbeam_filter_t tractorbeam_filter_t;
+
+/*! Compiles the patterns that select which nodes a walk visits.
+ *
+ * Patterns are absolute paths whose segments may use `*' and `?'
+ * (which never match `/') or be `**', which matches any number of
+ * segments. A pattern matches the nodes it names only, so a whole
+ * subtree needs a trailing `**'.
+ *
+ * \param includes The nodes to read (none means all of them);
+ *
+ * \param excludes The nodes to skip, along with their subtrees. These
+ *                 take precedence over includes;
+ *
+ * \param max_depth The deepest level to read, the root being 0 (-1
+ *                  means no limit);
+ *
+ * \return The filter or NULL if there was any error (e.g. a pattern
+ *         that is not absolute);
+ */
+tractorbeam_filter_t *tractorbeam_filter_init(char * const *includes, int nincludes, char * const *excludes, int nexcludes, int max_depth);
+
+/*! Tells what to do with a node, provided its parent has been listed.
+ *
+ * \param path The absolute path of the node;
+ *
+ * \param depth The level of the node (see max_depth);
+ *
+ * \return 0 if the node (and its subtree) must be skipped, otherwise
+ *         a combination of TB_FILTER_LIST (its children may be
+ *         selected) and TB_FILTER_FETCH (the node itself is selected);
+ */
+int tractorbeam_filter_check(const tractorbeam_filter_t *, const char *path, size_t depth);
+
+/*! Free all resources used by this filter.
+ */
+void tractorbeam_filter_term(tractorbeam_filter_t *);
+
+#endif
@@ -0,0 +1,260 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/fswriter.h"
+
+#define TBFW_DIRMODE (S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)
+
+/* Paths and contents live right after the job, in one allocation. */
+typedef struct tbfw_job_t
+{
+  struct tbfw_job_t *next;
+  char *dir;
+  char *file;
+  char *data;
+  size_t size;
+  size_t memory;
+} tbfw_job_t;
+
+struct tractorbeam_fswriter_t
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+  pthread_cond_t room;
+  pthread_t *threads;
+  int nthreads;
+  tbfw_job_t *head;
+  tbfw_job_t *tail;
+  size_t queued;
+  size_t max_queued;
+  int closing;
+  int failed;
+};
+
+/* Creates the parents of path (up to the last `/'). */
+static
+int __tbfw_parents(char *path)
+{
+  char *sep = strrchr(path, '/');
+  if (sep == NULL || sep == path)
+  { return(0); }
+
+  *sep   = '\0';
+  int rc = mkdir(path, TBFW_DIRMODE);
+  if (rc != 0 && errno == ENOENT && __tbfw_parents(path) == 0)
+  { rc = mkdir(path, TBFW_DIRMODE); }
+  if (rc != 0 && errno == EEXIST)
+  { rc = 0; }
+  *sep = '/';
+  return(rc);
+}
+
+static
+int __tbfw_mkdir(char *dir)
+{
+  int rc = mkdir(dir, TBFW_DIRMODE);
+  if (rc != 0 && errno == ENOENT && __tbfw_parents(dir) == 0)
+  { rc = mkdir(dir, TBFW_DIRMODE); }
+  return((rc == 0 || errno == EEXIST) ? 0 : -1);
+}
+
+static
+int __tbfw_write(tbfw_job_t *job)
+{
+  int fd = open(job->file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd == -1 && errno == ENOENT && __tbfw_parents(job->file) == 0)
+  { fd = open(job->file, O_WRONLY | O_CREAT | O_TRUNC, 0666); }
+  if (fd == -1)
+  { return(-1); }
+
+  size_t off = 0;
+  while (off < job->size)
+  {
+    ssize_t n = write(fd, job->data + off, job->size - off);
+    if (n == -1 && errno == EINTR)
+    { continue; }
+    else if (n <= 0)
+    { break; }
+    off += (size_t) n;
+  }
+  if (close(fd) != 0 || off < job->size)
+  { return(-1); }
+  return(0);
+}
+
+static
+void *__tbfw_worker(void *ctx)
+{
+  tractorbeam_fswriter_t *w = (tractorbeam_fswriter_t *) ctx;
+  if (pthread_mutex_lock(&w->mutex) != 0)
+  { return(NULL); }
+
+  while (1)
+  {
+    while (w->head == NULL && ! w->closing)
+    { pthread_cond_wait(&w->ready, &w->mutex); }
+    tbfw_job_t *job = w->head;
+    if (job == NULL)
+    { break; }
+    w->head = job->next;
+    if (w->head == NULL)
+    { w->tail = NULL; }
+    pthread_mutex_unlock(&w->mutex);
+
+    int rc = __tbfw_mkdir(job->dir);
+    if (rc != 0)
+    { TB_DEBUG("could not create directory: %s", job->dir); }
+    else if (job->file != NULL && (rc = __tbfw_write(job)) != 0)
+    { TB_DEBUG("could not write file: %s", job->file); }
+
+    pthread_mutex_lock(&w->mutex);
+    w->queued -= job->memory;
+    w->failed  = w->failed || rc != 0;
+    pthread_cond_signal(&w->room);
+    free(job);
+  }
+
+  pthread_mutex_unlock(&w->mutex);
+  return(NULL);
+}
+
+tractorbeam_fswriter_t *tractorbeam_fswriter_init(int threads, size_t max_queued)
+{
+  tractorbeam_fswriter_t *w = (tractorbeam_fswriter_t *) malloc(sizeof(tractorbeam_fswriter_t));
+  if (w == NULL)
+  { return(NULL); }
+  memset(w, 0, sizeof(tractorbeam_fswriter_t));
+  w->max_queued = max_queued;
+
+  w->threads = (pthread_t *) malloc(sizeof(pthread_t) * (size_t) threads);
+  if (w->threads == NULL)
+  { goto handle_error; }
+  if (pthread_mutex_init(&w->mutex, NULL) != 0)
+  { goto handle_error; }
+  if (pthread_cond_init(&w->ready, NULL) != 0)
+  {
+    pthread_mutex_destroy(&w->mutex);
+    goto handle_error;
+  }
+  if (pthread_cond_init(&w->room, NULL) != 0)
+  {
+    pthread_cond_destroy(&w->ready);
+    pthread_mutex_destroy(&w->mutex);
+    goto handle_error;
+  }
+
+  for (; w->nthreads<threads; w->nthreads+=1)
+  {
+    if (pthread_create(&w->threads[w->nthreads], NULL, __tbfw_worker, w) != 0)
+    {
+      tractorbeam_fswriter_term(w);
+      return(NULL);
+    }
+  }
+  return(w);
+
+handle_error:
+  free(w->threads);
+  free(w);
+  return(NULL);
+}
+
+int tractorbeam_fswriter_put(tractorbeam_fswriter_t *w, const char *dir, const char *file, const void *data, size_t size)
+{
+  size_t dirlen  = strlen(dir) + 1;
+  size_t filelen = (file == NULL) ? 0 : strlen(file) + 1;
+  size_t memory  = sizeof(tbfw_job_t) + dirlen + filelen + size;
+  tbfw_job_t *job = (tbfw_job_t *) malloc(memory);
+  if (job == NULL)
+  { return(-1); }
+
+  job->next   = NULL;
+  job->dir    = (char *) (job + 1);
+  job->file   = (file == NULL) ? NULL : job->dir + dirlen;
+  job->data   = job->dir + dirlen + filelen;
+  job->size   = size;
+  job->memory = memory;
+  memcpy(job->dir, dir, dirlen);
+  if (file != NULL)
+  { memcpy(job->file, file, filelen); }
+  if (size > 0)
+  { memcpy(job->data, data, size); }
+
+  if (pthread_mutex_lock(&w->mutex) != 0)
+  {
+    free(job);
+    return(-1);
+  }
+  // a single job larger than the limit goes once the queue is empty
+  while (! w->failed && w->queued > 0 && w->queued + memory > w->max_queued)
+  { pthread_cond_wait(&w->room, &w->mutex); }
+  if (w->failed)
+  {
+    pthread_mutex_unlock(&w->mutex);
+    free(job);
+    return(-1);
+  }
+
+  if (w->tail == NULL)
+  { w->head = job; }
+  else
+  { w->tail->next = job; }
+  w->tail    = job;
+  w->queued += memory;
+  pthread_cond_signal(&w->ready);
+  pthread_mutex_unlock(&w->mutex);
+  return(0);
+}
+
+int tractorbeam_fswriter_term(tractorbeam_fswriter_t *w)
+{
+  if (pthread_mutex_lock(&w->mutex) == 0)
+  {
+    w->closing = 1;
+    pthread_cond_broadcast(&w->ready);
+    pthread_mutex_unlock(&w->mutex);
+  }
+  for (int k=0; k<w->nthreads; k+=1)
+  { pthread_join(w->threads[k], NULL); }
+
+  int rc = w->failed ? -1 : 0;
+  pthread_cond_destroy(&w->room);
+  pthread_cond_destroy(&w->ready);
+  pthread_mutex_destroy(&w->mutex);
+  free(w->threads);
+  free(w);
+  return(rc);
+}
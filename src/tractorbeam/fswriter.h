@@ -0,0 +1,74 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_fswriter_h__
+#define __tractorbeam_fswriter_h__
+
+#include <stdlib.h>
+
+typedef struct tractorbeam_fswriter_t tractorbeam_fswriter_t;
+
+/*! Creates directories and writes files in the background.
+ *
+ * Jobs are queued and carried out by a pool of threads, in any order:
+ * missing parents get created on demand, so a job never depends on
+ * the ones queued before it.
+ *
+ * \param threads The number of threads writing (>0);
+ *
+ * \param max_queued The memory for jobs that have not been carried
+ *                   out yet, in bytes. Beyond this
+ *                   tractorbeam_fswriter_put blocks;
+ *
+ * \return The writer or NULL if there was any error;
+ */
+tractorbeam_fswriter_t *tractorbeam_fswriter_init(int threads, size_t max_queued);
+
+/*! Queues the creation of a directory and (optionally) a file.
+ *
+ * \param dir The directory to create (it may exist already);
+ *
+ * \param file The file to write (NULL means none);
+ *
+ * \param data The contents of the file (copied);
+ *
+ * \return 0: success;
+ *
+ * \return -1: error (including a job that has failed before);
+ */
+int tractorbeam_fswriter_put(tractorbeam_fswriter_t *, const char *dir, const char *file, const void *data, size_t size);
+
+/*! Waits for the jobs queued and frees all resources used by this
+ *  writer.
+ *
+ * \return 0: every job has succeeded;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_fswriter_term(tractorbeam_fswriter_t *);
+
+#endif
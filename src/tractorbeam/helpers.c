@@ -25,18 +25,24 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "tractorbeam/debug.h"
+#include "tractorbeam/helpers.h"
 
 char *tbh_strdup(const char *s)
 {
   size_t len = strlen(s);
   char *r    = (char *) malloc(sizeof(char) * (len + 1));
   if (r != NULL)
-  { strncpy(r, s, len); }
-  r[len] = '\0';
+  { memcpy(r, s, len + 1); }
   return(r);
 }
 
@@ -58,16 +64,92 @@ char *tbh_join(const char *base, ...)
   { return(NULL); }
 
   va_start(args, base);
-  strcpy(path, base);
+  memcpy(path, base, offset);
   while ((item = va_arg(args, char*)) != NULL)
   {
-    if (strcmp(item, "") == 0)
-    { continue; }
-    strcpy(path+offset, item);
-    offset += strlen(item);
+    size_t len = strlen(item);
+    memcpy(path+offset, item, len);
+    offset += len;
   }
   path[offset] = '\0';
   va_end(args);
 
   return(path);
 }
+
+int tbh_grow(char **buf, size_t *bufsz, size_t need, size_t initial, size_t maxsz)
+{
+  size_t cap = (*bufsz == 0) ? initial : *bufsz;
+  if (need <= *bufsz)
+  { return(0); }
+  if (need > maxsz)
+  { return(-1); }
+
+  while (cap < need)
+  { cap *= 2; }
+  if (cap > maxsz)
+  { cap = maxsz; }
+
+  char *tmp = (char *) realloc(*buf, cap);
+  if (tmp == NULL)
+  { return(-1); }
+  *buf   = tmp;
+  *bufsz = cap;
+  return(0);
+}
+
+FILE *tbh_replace_open(const char *file, char **tmp)
+{
+  struct stat st;
+  FILE *fh = NULL;
+  int fd   = -1;
+
+  *tmp = tbh_join(file, ".XXXXXX", NULL);
+  if (*tmp != NULL && (fd = mkstemp(*tmp)) != -1)
+  {
+    mode_t mask = umask(0);
+    umask(mask);
+    if (stat(file, &st) == 0)
+    {
+      fchmod(fd, st.st_mode & 07777);
+      if (st.st_size > 0)
+      { posix_fallocate(fd, 0, st.st_size); }
+    }
+    else
+    { fchmod(fd, 0666 & ~mask); }
+    if ((fh = fdopen(fd, "w")) == NULL)
+    {
+      close(fd);
+      unlink(*tmp);
+    }
+  }
+
+  if (fh == NULL)
+  {
+    TB_DEBUG("could not open file: %s", file);
+    free(*tmp);
+    *tmp = NULL;
+  }
+  return(fh);
+}
+
+int tbh_replace_close(FILE *fh, const char *file, char *tmp, int rc)
+{
+  if (fflush(fh) != 0)
+  { rc = -1; }
+
+  off_t size = ftello(fh);
+  if (rc == 0 && (size < 0 || ftruncate(fileno(fh), size) != 0 || fsync(fileno(fh)) != 0))
+  { rc = -1; }
+  if (fclose(fh) != 0)
+  { rc = -1; }
+  if (rc == 0 && rename(tmp, file) != 0)
+  {
+    TB_DEBUG("could not rename file: %s", file);
+    rc = -1;
+  }
+  if (rc != 0)
+  { unlink(tmp); }
+  free(tmp);
+  return(rc);
+}
@@ -28,10 +28,44 @@
 #ifndef __tractorbeam_helpers_h__
 #define __tractorbeam_helpers_h__
 
+#include <stdio.h>
+#include <stdlib.h>
+
 #define UNUSED(v) ((void) v)
 
 char *tbh_strdup(const char *);
 
 char *tbh_join(const char *, ...);
 
+/*! Grows buf (doubling from initial) so that it holds at least need
+ *  bytes, but never beyond maxsz.
+ *
+ * \return 0: success (buf and bufsz updated);
+ *
+ * \return -1: need > maxsz or out of memory (buf is left untouched);
+ */
+int tbh_grow(char **buf, size_t *bufsz, size_t need, size_t initial, size_t maxsz);
+
+/*! Opens a temporary file next to file, to be renamed over it by
+ *  tbh_replace_close, so that readers never see a partially written
+ *  file. It gets the mode of file, if it exists, and its size
+ *  preallocated.
+ *
+ * \param tmp Gets the name of the temporary file (freed by
+ *            tbh_replace_close);
+ *
+ * \return The temporary file or NULL if there was any error;
+ */
+FILE *tbh_replace_open(const char *file, char **tmp);
+
+/*! Closes a file opened by tbh_replace_open. It replaces file only if
+ *  rc is 0 and everything has been written, and it is removed
+ *  otherwise (file is kept as it was).
+ *
+ * \return 0: success;
+ *
+ * \return -1: error (or rc was not 0);
+ */
+int tbh_replace_close(FILE *fh, const char *file, char *tmp, int rc);
+
 #endif
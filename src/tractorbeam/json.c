@@ -0,0 +1,212 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdint.h>
+#include <string.h>
+#include "tractorbeam/json.h"
+
+#define TBJ_ONES  0x0101010101010101ULL
+#define TBJ_HIGHS 0x8080808080808080ULL
+
+/* Words are checked 8 bytes at a time, using the usual bit tricks to
+ * find bytes that are zero (or below a value), and only the words
+ * with something to look at go through the bytewise loop. */
+static
+uint64_t __tbj_load(const char *s)
+{
+  uint64_t w;
+  memcpy(&w, s, sizeof(w));
+  return(w);
+}
+
+static
+uint64_t __tbj_haszero(uint64_t w)
+{ return((w - TBJ_ONES) & ~w & TBJ_HIGHS); }
+
+static
+int __tbj_special(unsigned char c)
+{ return(c < 0x20 || c == '"' || c == '\\'); }
+
+size_t tractorbeam_json_clean(const char *s, size_t size)
+{
+  size_t k = 0;
+  for (; k + 8 <= size; k+=8)
+  {
+    uint64_t w = __tbj_load(s + k);
+    // bytes below 0x20 (ignoring the ones above 0x7f), `"' and `\'
+    if (((w - TBJ_ONES * 0x20) & ~w & TBJ_HIGHS)
+        | __tbj_haszero(w ^ (TBJ_ONES * '"'))
+        | __tbj_haszero(w ^ (TBJ_ONES * '\\')))
+    { break; }
+  }
+  while (k < size && ! __tbj_special((unsigned char) s[k]))
+  { k += 1; }
+  return(k);
+}
+
+int tractorbeam_json_utf8(const char *s, size_t size)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  size_t k = 0;
+  while (k < size)
+  {
+    if (k + 8 <= size && (__tbj_load(s + k) & TBJ_HIGHS) == 0)
+    {
+      k += 8;
+      continue;
+    }
+    if (p[k] < 0x80)
+    {
+      k += 1;
+      continue;
+    }
+
+    size_t n;
+    uint32_t cp;
+    if (p[k] >= 0xc2 && p[k] <= 0xdf)
+    {
+      n  = 1;
+      cp = p[k] & 0x1f;
+    }
+    else if (p[k] >= 0xe0 && p[k] <= 0xef)
+    {
+      n  = 2;
+      cp = p[k] & 0x0f;
+    }
+    else if (p[k] >= 0xf0 && p[k] <= 0xf4)
+    {
+      n  = 3;
+      cp = p[k] & 0x07;
+    }
+    else
+    { return(0); }
+    if (k + n >= size)
+    { return(0); }
+    for (size_t j=1; j<=n; j+=1)
+    {
+      if ((p[k+j] & 0xc0) != 0x80)
+      { return(0); }
+      cp = (cp << 6) | (p[k+j] & 0x3f);
+    }
+    if ((n == 2 && (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))) || (n == 3 && (cp < 0x10000 || cp > 0x10ffff)))
+    { return(0); }
+    k += n + 1;
+  }
+  return(1);
+}
+
+static
+int __tbj_flush(FILE *out, const char *buffer, size_t *len)
+{
+  if (*len > 0 && fwrite(buffer, sizeof(char), *len, out) != *len)
+  { return(-1); }
+  *len = 0;
+  return(0);
+}
+
+/* Short runs and escapes are gathered in a local buffer, as a write
+ * per run costs more than the scan itself with payloads full of
+ * quotes (e.g. json). */
+int tractorbeam_json_escape(FILE *out, const char *s, size_t size)
+{
+  static const char hex[] = "0123456789abcdef";
+  char buffer[4096];
+  size_t len = 0;
+  size_t k   = 0;
+  while (k < size)
+  {
+    size_t n = tractorbeam_json_clean(s + k, size - k);
+    if (len + n > sizeof(buffer) && __tbj_flush(out, buffer, &len) != 0)
+    { return(-1); }
+    if (n > sizeof(buffer))
+    {
+      if (fwrite(s + k, sizeof(char), n, out) != n)
+      { return(-1); }
+    }
+    else
+    {
+      memcpy(buffer + len, s + k, n);
+      len += n;
+    }
+    k += n;
+    if (k == size)
+    { break; }
+
+    if (len + 6 > sizeof(buffer) && __tbj_flush(out, buffer, &len) != 0)
+    { return(-1); }
+    unsigned char c = (unsigned char) s[k];
+    buffer[len++]   = '\\';
+    switch (c)
+    {
+    case '"':  buffer[len++] = '"'; break;
+    case '\\': buffer[len++] = '\\'; break;
+    case '\n': buffer[len++] = 'n'; break;
+    case '\r': buffer[len++] = 'r'; break;
+    case '\t': buffer[len++] = 't'; break;
+    case '\b': buffer[len++] = 'b'; break;
+    case '\f': buffer[len++] = 'f'; break;
+    default:
+      buffer[len++] = 'u';
+      buffer[len++] = '0';
+      buffer[len++] = '0';
+      buffer[len++] = hex[c >> 4];
+      buffer[len++] = hex[c & 0x0f];
+    }
+    k += 1;
+  }
+  return(__tbj_flush(out, buffer, &len));
+}
+
+int tractorbeam_json_base64(FILE *out, const void *data, size_t size)
+{
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const unsigned char *p = (const unsigned char *) data;
+  char buffer[4096];
+  size_t len = 0;
+
+  for (size_t k=0; k<size; k+=3)
+  {
+    uint32_t v = (uint32_t) p[k] << 16;
+    if (k + 1 < size)
+    { v |= (uint32_t) p[k+1] << 8; }
+    if (k + 2 < size)
+    { v |= p[k+2]; }
+    buffer[len++] = alphabet[(v >> 18) & 0x3f];
+    buffer[len++] = alphabet[(v >> 12) & 0x3f];
+    buffer[len++] = (k + 1 < size) ? alphabet[(v >> 6) & 0x3f] : '=';
+    buffer[len++] = (k + 2 < size) ? alphabet[v & 0x3f] : '=';
+    if (len + 4 > sizeof(buffer))
+    {
+      if (fwrite(buffer, sizeof(char), len, out) != len)
+      { return(-1); }
+      len = 0;
+    }
+  }
+  if (len > 0 && fwrite(buffer, sizeof(char), len, out) != len)
+  { return(-1); }
+  return(0);
+}
@@ -0,0 +1,63 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_json_h__
+#define __tractorbeam_json_h__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*! The length of the longest prefix which needs no escaping as a json
+ *  string, i.e., has no control characters, `"' or `\'. Bytes above
+ *  0x7f are accepted, so validate these first (see
+ *  tractorbeam_json_utf8).
+ */
+size_t tractorbeam_json_clean(const char *s, size_t size);
+
+/*! Tells whether the buffer is valid UTF-8 (no overlong sequences,
+ *  surrogates or code points above U+10FFFF).
+ */
+int tractorbeam_json_utf8(const char *s, size_t size);
+
+/*! Writes the buffer escaped as the contents of a json string (the
+ *  quotes are not written).
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_json_escape(FILE *out, const char *s, size_t size);
+
+/*! Writes the buffer encoded as base64.
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_json_base64(FILE *out, const void *data, size_t size);
+
+#endif
@@ -25,13 +25,65 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+#include <errno.h>
 #include <libgen.h>
 #include <string.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <zookeeper/zookeeper.h>
 #include "tractorbeam/debug.h"
+#include "tractorbeam/probe.h"
 #include "tractorbeam/helpers.h"
+#include "tractorbeam/spool.h"
+#include "tractorbeam/filter.h"
+#include "tractorbeam/fanout.h"
 #include "tractorbeam/monitor.h"
+#include "tractorbeam/ratelimit.h"
+
+#define TBM_BACKOFF_MIN 500
+#define TBM_BACKOFF_MAX 60000
+#define TBM_NAMES_BATCH 4096
+#define TBM_NAMES_MEMORY 33554432
+#define TBM_BUFFER_MIN 4096
+#define TBM_BUFFER_LIMIT 1048576
+#define TBM_GET_RETRIES 3
+
+typedef struct
+{
+  tractorbeam_spool_t *children;
+  size_t pathlen;
+} tbm_frame_t;
+
+typedef enum
+{
+  TBM_OP_CREATE,
+  TBM_OP_SET,
+  TBM_OP_DELETE,
+  TBM_OP_CHECK
+} tbm_optype_t;
+
+typedef struct
+{
+  tbm_optype_t type;
+  char *path;
+  char *data;
+  int datasize;
+  int version;
+  int flags;
+} tbm_op_t;
+
+struct tractorbeam_batch_t
+{
+  tbm_op_t *ops;
+  size_t count;
+  size_t cap;
+  zoo_op_t *zops;
+  zoo_op_result_t *results;
+  size_t zcap;
+};
 
 struct tractorbeam_monitor_t
 {
@@ -40,8 +92,65 @@ struct tractorbeam_monitor_t
   char *znode;
   char *endpoint;
   pthread_mutex_t mutex;
+  pthread_mutex_t pmutex;
+  char *payload;
+  size_t paysize;
+  size_t paycap;
+  int haspayload;
+  int expired;
+  pthread_t reconnector;
+  pthread_mutex_t smutex;
+  pthread_cond_t scond;
+  int state;
+  int reconnect;
+  int heal;
+  int closing;
+  int backoff;
+  int threaded;
+  unsigned int seed;
+  tractorbeam_ratelimit_t *ratelimit;
+  tractorbeam_filter_t *filter;
+  tb_monitor_data_e datamode;
+  size_t lazylimit;
+  char *path;
+  size_t pathcap;
+  tbm_frame_t *stack;
+  size_t stackcap;
+  size_t namebudget;
+  size_t namememory;
+  int sorted;
+  char *buffer;
+  size_t bufcap;
+  size_t buflimit;
+  tractorbeam_batch_t *batch;
+  tb_change_fn changefn;
+  void *changedata;
 };
 
+static
+void __tbm_deadline(struct timespec *ts, int timeout_in_ms)
+{
+  clock_gettime(CLOCK_REALTIME, ts);
+  ts->tv_sec  += timeout_in_ms / 1000;
+  ts->tv_nsec += (long) (timeout_in_ms % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L)
+  {
+    ts->tv_sec  += 1;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+/* Must be called with smutex held. */
+static
+void __tbm_setstate(tractorbeam_monitor_t *mh, int state, int reconnect)
+{
+  mh->state      = state;
+  mh->reconnect |= reconnect;
+  if (state == ZOO_CONNECTED_STATE)
+  { mh->backoff = TBM_BACKOFF_MIN; }
+  pthread_cond_broadcast(&mh->scond);
+}
+
 static
 void __tbm_reconnect(tractorbeam_monitor_t *mh, watcher_fn fn)
 {
@@ -50,25 +159,335 @@ void __tbm_reconnect(tractorbeam_monitor_t *mh, watcher_fn fn)
 
   if (mh->zh != NULL)
   { zookeeper_close(mh->zh); }
+  if (pthread_mutex_lock(&mh->smutex) == 0)
+  {
+    __tbm_setstate(mh, ZOO_CONNECTING_STATE, 0);
+    pthread_mutex_unlock(&mh->smutex);
+  }
   mh->zh = zookeeper_init(mh->endpoint, fn, mh->timeout, NULL, mh, 0);
+  if (mh->zh == NULL && pthread_mutex_lock(&mh->smutex) == 0)
+  {
+    TB_DEBUG("error connecting to zookeeper: %s", mh->endpoint);
+    __tbm_setstate(mh, ZOO_EXPIRED_SESSION_STATE, 1);
+    pthread_mutex_unlock(&mh->smutex);
+  }
 
   pthread_mutex_unlock(&mh->mutex);
 }
 
+static void __tbm_watcher(zhandle_t *, int, int, const char *, void *);
+static int __tbm_reheal(tractorbeam_monitor_t *);
+
+/* Reconnects are never done right away: each attempt waits for a
+ * random delay in [backoff/2, backoff] and doubles the backoff, which
+ * only resets once a session gets established. This prevents a fleet
+ * from reconnecting in lockstep after an outage.
+ *
+ * Failed attempts to restore the znode (see __tbm_heal) are retried
+ * here as well, with the same backoff.
+ */
 static
-void __tbm_watcher(zhandle_t *zh, int type, int state, const char *path, void *ctx)
+void *__tbm_reconnector(void *ctx)
+{
+  tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) ctx;
+  struct timespec deadline;
+
+  if (pthread_mutex_lock(&mh->smutex) != 0)
+  { return(NULL); }
+
+  while (! mh->closing)
+  {
+    if (! mh->reconnect && ! mh->heal)
+    {
+      pthread_cond_wait(&mh->scond, &mh->smutex);
+      continue;
+    }
+
+    int delay = mh->backoff / 2 + rand_r(&mh->seed) % (mh->backoff / 2 + 1);
+    if (mh->reconnect)
+    { TB_DEBUG("reconnecting in %dms", delay); }
+    else
+    { TB_DEBUG("restoring znode in %dms", delay); }
+    __tbm_deadline(&deadline, delay);
+    while (! mh->closing && pthread_cond_timedwait(&mh->scond, &mh->smutex, &deadline) != ETIMEDOUT)
+    { }
+    if (mh->closing)
+    { break; }
+
+    mh->backoff = (mh->backoff * 2 > TBM_BACKOFF_MAX) ? TBM_BACKOFF_MAX : mh->backoff * 2;
+    if (mh->reconnect)
+    {
+      mh->reconnect = 0;
+      pthread_mutex_unlock(&mh->smutex);
+      __tbm_reconnect(mh, __tbm_watcher);
+    }
+    else
+    {
+      mh->heal = 0;
+      pthread_mutex_unlock(&mh->smutex);
+      if (__tbm_reheal(mh) != 0)
+      {
+        if (pthread_mutex_lock(&mh->smutex) != 0)
+        { return(NULL); }
+        mh->heal = 1;
+        continue;
+      }
+    }
+    if (pthread_mutex_lock(&mh->smutex) != 0)
+    { return(NULL); }
+  }
+
+  pthread_mutex_unlock(&mh->smutex);
+  return(NULL);
+}
+
+static
+int __tbm_cache(tractorbeam_monitor_t *mh, const void *data, size_t datasize)
+{
+  if (pthread_mutex_lock(&mh->pmutex) != 0)
+  { return(-1); }
+
+  if (data != NULL && datasize > mh->paycap)
+  {
+    char *tmp = (char *) realloc(mh->payload, datasize);
+    if (tmp == NULL)
+    {
+      mh->haspayload = 0;
+      pthread_mutex_unlock(&mh->pmutex);
+      return(-1);
+    }
+    mh->payload = tmp;
+    mh->paycap  = datasize;
+  }
+
+  mh->paysize    = (data == NULL) ? 0 : datasize;
+  mh->haspayload = 1;
+  if (mh->paysize > 0)
+  { memcpy(mh->payload, data, datasize); }
+
+  pthread_mutex_unlock(&mh->pmutex);
+  return(0);
+}
+
+static
+void __tbm_forget(tractorbeam_monitor_t *mh)
+{
+  if (pthread_mutex_lock(&mh->pmutex) != 0)
+  { return; }
+  mh->haspayload = 0;
+  pthread_mutex_unlock(&mh->pmutex);
+}
+
+/* Hands the znode over to the reconnector, which restores it (and
+ * the watch) using the synchronous API. */
+static
+void __tbm_unhealed(tractorbeam_monitor_t *mh)
+{
+  if (pthread_mutex_lock(&mh->smutex) == 0)
+  {
+    mh->heal = 1;
+    pthread_cond_broadcast(&mh->scond);
+    pthread_mutex_unlock(&mh->smutex);
+  }
+}
+
+static
+void __tbm_armed(int rc, const struct Stat *stat, const void *ctx)
+{
+  UNUSED(stat);
+  tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) ctx;
+  if (rc != ZOK && rc != ZNONODE)
+  {
+    TB_DEBUG("error watching own znode: %d", rc);
+    __tbm_unhealed(mh);
+  }
+}
+
+/* A znode that exists already may be a stale one, left by a previous
+ * session, and is checked (and the watch armed) by the reconnector. */
+static
+void __tbm_healed(int rc, const char *value, const void *ctx)
+{
+  UNUSED(value);
+  tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) ctx;
+  if (rc == ZOK)
+  { TB_DEBUG("znode restored: %s", mh->znode); }
+  else
+  {
+    if (rc != ZNODEEXISTS)
+    { TB_DEBUG("error restoring znode: %s/%d", mh->znode, rc); }
+    __tbm_unhealed(mh);
+  }
+}
+
+static void __tbm_nodewatcher(zhandle_t *, int, int, const char *, void *);
+
+/* Runs on the zookeeper completion thread, which is why only the
+ * asynchronous API is used and the monitor mutex is never taken.
+ */
+static
+void __tbm_heal(tractorbeam_monitor_t *mh, zhandle_t *zh)
+{
+  if (pthread_mutex_lock(&mh->pmutex) != 0)
+  { return; }
+
+  if (mh->haspayload)
+  {
+    const char *data = (mh->paysize == 0) ? NULL : mh->payload;
+    int datasize     = (mh->paysize == 0) ? -1 : (int) mh->paysize;
+    if (zoo_awexists(zh, mh->znode, __tbm_nodewatcher, mh, __tbm_armed, mh) != ZOK
+        || zoo_acreate(zh, mh->znode, data, datasize, &ZOO_OPEN_ACL_UNSAFE, ZOO_EPHEMERAL, __tbm_healed, mh) != ZOK)
+    {
+      TB_DEBUG("error restoring znode: %s", mh->znode);
+      __tbm_unhealed(mh);
+    }
+  }
+
+  pthread_mutex_unlock(&mh->pmutex);
+}
+
+static
+void __tbm_nodewatcher(zhandle_t *zh, int type, int state, const char *path, void *ctx)
+{
+  UNUSED(state);
+  tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) ctx;
+
+  if (type == ZOO_SESSION_EVENT || path == NULL || strcmp(path, mh->znode) != 0)
+  { return; }
+
+  if (type == ZOO_DELETED_EVENT)
+  {
+    TB_DEBUG("znode has been removed: %s", path);
+    __tbm_heal(mh, zh);
+  }
+  else if (type == ZOO_CREATED_EVENT || type == ZOO_CHANGED_EVENT)
+  { zoo_awexists(zh, mh->znode, __tbm_nodewatcher, mh, __tbm_armed, mh); }
+}
+
+static
+void __tbm_changewatcher(zhandle_t *zh, int type, int state, const char *path, void *ctx)
 {
   UNUSED(zh);
+  UNUSED(state);
+  UNUSED(path);
+  tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) ctx;
+  if (type != ZOO_SESSION_EVENT && mh->changefn != NULL)
+  { mh->changefn(mh->changedata); }
+}
+
+static
+void __tbm_watcher(zhandle_t *zh, int type, int state, const char *path, void *ctx)
+{
   UNUSED(path);
   tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) ctx;
 
   if (type == ZOO_SESSION_EVENT)
   {
+    if (pthread_mutex_lock(&mh->smutex) == 0)
+    {
+      __tbm_setstate(mh, state, state == ZOO_EXPIRED_SESSION_STATE);
+      pthread_mutex_unlock(&mh->smutex);
+    }
+
     if (state == ZOO_EXPIRED_SESSION_STATE)
-    { __tbm_reconnect(mh, __tbm_watcher); }
+    { mh->expired = 1; }
+    else if (state == ZOO_CONNECTED_STATE && mh->expired)
+    {
+      mh->expired = 0;
+      __tbm_heal(mh, zh);
+      // watches set by snapshots are gone along with the session
+      if (mh->changefn != NULL)
+      { mh->changefn(mh->changedata); }
+    }
   }
 }
 
+/* The path and the data get copied into a single allocation. */
+static
+int __tbm_batch_push(tractorbeam_batch_t *b, tbm_optype_t type, const char *base, const char *name, const void *data, size_t datasize, int version, int flags)
+{
+  if (datasize > 0x7fffffff)
+  { return(-1); }
+
+  if (b->count == b->cap)
+  {
+    size_t cap    = (b->cap == 0) ? 8 : b->cap * 2;
+    tbm_op_t *tmp = (tbm_op_t *) realloc(b->ops, sizeof(tbm_op_t) * cap);
+    if (tmp == NULL)
+    { return(-1); }
+    b->ops = tmp;
+    b->cap = cap;
+  }
+
+  size_t baselen = strlen(base);
+  size_t namelen = (name == NULL) ? 0 : strlen(name) + 1;
+  char *path     = (char *) malloc(baselen + namelen + 1 + datasize);
+  if (path == NULL)
+  { return(-1); }
+  memcpy(path, base, baselen);
+  if (name != NULL)
+  {
+    path[baselen] = '/';
+    memcpy(path + baselen + 1, name, namelen - 1);
+  }
+  path[baselen + namelen] = '\0';
+
+  tbm_op_t *op = &b->ops[b->count];
+  op->type     = type;
+  op->path     = path;
+  op->data     = (data == NULL) ? NULL : path + baselen + namelen + 1;
+  op->datasize = (data == NULL) ? -1 : (int) datasize;
+  op->version  = version;
+  op->flags    = flags;
+  if (datasize > 0)
+  { memcpy(op->data, data, datasize); }
+  b->count += 1;
+  return(0);
+}
+
+/* Must be called with the monitor mutex held. */
+static
+int __tbm_commit(tractorbeam_monitor_t *mh, tractorbeam_batch_t *b)
+{
+  size_t k;
+  if (b->count == 0)
+  { return(0); }
+
+  if (b->count > b->zcap)
+  {
+    zoo_op_t *zops           = (zoo_op_t *) realloc(b->zops, sizeof(zoo_op_t) * b->count);
+    if (zops != NULL)
+    { b->zops = zops; }
+    zoo_op_result_t *results = (zoo_op_result_t *) realloc(b->results, sizeof(zoo_op_result_t) * b->count);
+    if (results != NULL)
+    { b->results = results; }
+    if (zops == NULL || results == NULL)
+    { return(-1); }
+    b->zcap = b->count;
+  }
+
+  for (k=0; k<b->count; k+=1)
+  {
+    tbm_op_t *op = &b->ops[k];
+    if (op->type == TBM_OP_CREATE)
+    { zoo_create_op_init(&b->zops[k], op->path, op->data, op->datasize, &ZOO_OPEN_ACL_UNSAFE, op->flags, NULL, 0); }
+    else if (op->type == TBM_OP_SET)
+    { zoo_set_op_init(&b->zops[k], op->path, op->data, op->datasize, op->version, NULL); }
+    else if (op->type == TBM_OP_DELETE)
+    { zoo_delete_op_init(&b->zops[k], op->path, op->version); }
+    else
+    { zoo_check_op_init(&b->zops[k], op->path, op->version); }
+  }
+
+  int rc = zoo_multi(mh->zh, (int) b->count, b->zops, b->results);
+  if (rc == ZNODEEXISTS || rc == ZNONODE || rc == ZBADVERSION)
+  { return(1); }
+  else if (rc == ZOK)
+  { return(0); }
+  else
+  { return(-1); }
+}
+
 static
 int __tbm_zkcreate(tractorbeam_monitor_t *mh, const void *data, size_t datasize)
 {
@@ -95,85 +514,476 @@ int __tbm_zkupdate(tractorbeam_monitor_t *mh, struct Stat *stat, const void *dat
   { return(-1); }
 }
 
+/* A znode left by a previous session is replaced (deleted and created
+ * again as our own) in a single multi request, guarded by its version.
+ */
 static
-int __tbm_zkcheck(tractorbeam_monitor_t *mh, struct Stat *stat)
+int __tbm_zkcheck(tractorbeam_monitor_t *mh, struct Stat *stat, const void *data, size_t datasize)
 {
   const clientid_t *client = zoo_client_id(mh->zh);
   if (client == NULL)
   { return(-1); }
-  
-  if (stat->ephemeralOwner != client->client_id)
+
+  if (stat->ephemeralOwner == client->client_id)
+  { return(__tbm_zkupdate(mh, stat, data, datasize)); }
+
+  if (mh->batch == NULL && (mh->batch = tractorbeam_batch_init()) == NULL)
+  { return(-1); }
+
+  tractorbeam_batch_clear(mh->batch);
+  if (__tbm_batch_push(mh->batch, TBM_OP_DELETE, mh->znode, NULL, NULL, 0, stat->version, 0) != 0
+      || __tbm_batch_push(mh->batch, TBM_OP_CREATE, mh->znode, NULL, data, datasize, -1, ZOO_EPHEMERAL) != 0)
+  { return(-1); }
+
+  TB_DEBUG("replacing stale znode: %s", mh->znode);
+  return(__tbm_commit(mh, mh->batch));
+}
+
+/* Must be called with the monitor mutex held. */
+static
+int __tbm_zkwrite(tractorbeam_monitor_t *mh, const void *data, size_t datasize)
+{
+  struct Stat stat;
+  int rc = zoo_wexists(mh->zh, mh->znode, __tbm_nodewatcher, mh, &stat);
+  if (rc == ZNONODE)
+  { return(__tbm_zkcreate(mh, data, datasize)); }
+  else if (rc == ZOK)
+  { return(__tbm_zkcheck(mh, &stat, data, datasize)); }
+  else
+  { return(-1); }
+}
+
+/* Writes the payload kept by the monitor (see __tbm_heal) again. This
+ * runs on the reconnector thread, so the synchronous API may be used.
+ */
+static
+int __tbm_reheal(tractorbeam_monitor_t *mh)
+{
+  char *data      = NULL;
+  size_t datasize = 0;
+  int haspayload  = 0;
+  int code        = -1;
+
+  if (tractorbeam_monitor_wait(mh, mh->timeout) != 0)
+  { return(1); }
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  { return(-1); }
+
+  // copied, as the completion thread may take pmutex while waiting
+  // for the requests below
+  if (pthread_mutex_lock(&mh->pmutex) == 0)
   {
-    int rc = zoo_delete(mh->zh, mh->znode, stat->version);
-    if (rc == ZOK || rc == ZBADVERSION)
-    { return(1); }
-    else
-    { return(-1); }
+    haspayload = mh->haspayload;
+    datasize   = mh->paysize;
+    if (haspayload && datasize > 0 && (data = (char *) malloc(datasize)) != NULL)
+    { memcpy(data, mh->payload, datasize); }
+    pthread_mutex_unlock(&mh->pmutex);
   }
-  else
-  { return(0); }
+
+  if (! haspayload)
+  { code = 0; }
+  else if (mh->zh == NULL)
+  { code = 1; }
+  else if (datasize == 0 || data != NULL)
+  { code = __tbm_zkwrite(mh, data, datasize); }
+
+  pthread_mutex_unlock(&mh->mutex);
+  free(data);
+  if (code == 0)
+  { TB_DEBUG("znode restored: %s", mh->znode); }
+  return(code);
 }
 
 static
-int __tbm_snapshot(tractorbeam_monitor_t *mh, const char *ppath, const char *name, int *status, char *buffer, size_t bufsize, tb_snapshot_fn callback, void *data)
+int __tbm_strcmp(const void *a, const void *b)
+{ return(strcmp(*(char * const *) a, *(char * const *) b)); }
+
+static
+int __tbm_haschild(const struct String_vector *children, const char *name)
+{ return(children->count > 0 && bsearch(&name, children->data, children->count, sizeof(char *), __tbm_strcmp) != NULL); }
+
+/* Queues the write of a child that already exists. A child left by
+ * another session (e.g. before a restart) would go away along with
+ * it, so it gets replaced (deleted and created again as our own)
+ * instead of set, as in __tbm_zkcheck.
+ */
+static
+int __tbm_zkchild(tractorbeam_monitor_t *mh, tractorbeam_batch_t *b, const clientid_t *client, const tractorbeam_fanout_entry_t *e)
 {
-  struct String_vector children;
-  int rc, zrc;
-  int r_bufsize = (int) bufsize;
-  char *path    = tbh_join(ppath, "/", name, NULL);
+  struct Stat stat;
+  char *path = tbh_join(mh->znode, "/", e->key, NULL);
   if (path == NULL)
   { return(-1); }
+  int rc = zoo_exists(mh->zh, path, 0, &stat);
+  free(path);
+
+  if (rc == ZNONODE)
+  { return(__tbm_batch_push(b, TBM_OP_CREATE, mh->znode, e->key, e->value, e->valsize, -1, ZOO_EPHEMERAL)); }
+  else if (rc != ZOK)
+  { return(-1); }
+  else if (stat.ephemeralOwner == client->client_id)
+  { return(__tbm_batch_push(b, TBM_OP_SET, mh->znode, e->key, e->value, e->valsize, stat.version, 0)); }
 
-  TB_DEBUG("__tbm_snapshot: %s,%s => %s", ppath, name, path);
-  rc  = -1;
-  zrc = zoo_get_children(mh->zh, path, 0, &children);
-  if (zrc != ZOK)
+  TB_DEBUG("replacing stale znode: %s/%s", mh->znode, e->key);
+  if (__tbm_batch_push(b, TBM_OP_DELETE, mh->znode, e->key, NULL, 0, stat.version, 0) != 0)
+  { return(-1); }
+  return(__tbm_batch_push(b, TBM_OP_CREATE, mh->znode, e->key, e->value, e->valsize, -1, ZOO_EPHEMERAL));
+}
+
+/* Writes only the keys that are missing or whose value has changed
+ * since the last time they were published, and deletes the keys that
+ * are gone, all in a single (atomic) multi request.
+ */
+static
+int __tbm_zkfanout(tractorbeam_monitor_t *mh, struct String_vector *children, const tractorbeam_fanout_t *published, const tractorbeam_fanout_t *current)
+{
+  tractorbeam_batch_t *b = mh->batch;
+  int rc = 0;
+  size_t k;
+
+  const clientid_t *client = zoo_client_id(mh->zh);
+  if (client == NULL)
+  { return(-1); }
+  if (b == NULL && (b = mh->batch = tractorbeam_batch_init()) == NULL)
+  { return(-1); }
+  if (children->count > 0)
+  { qsort(children->data, children->count, sizeof(char *), __tbm_strcmp); }
+
+  tractorbeam_batch_clear(b);
+  for (k=0; rc == 0 && k<tractorbeam_fanout_count(current); k+=1)
   {
-    TB_DEBUG("error listing children of: %s", path);
-    goto handle_error;
+    const tractorbeam_fanout_entry_t *e = tractorbeam_fanout_entry(current, k);
+    const tractorbeam_fanout_entry_t *p = tractorbeam_fanout_find(published, e->key);
+    if (! __tbm_haschild(children, e->key))
+    { rc = __tbm_batch_push(b, TBM_OP_CREATE, mh->znode, e->key, e->value, e->valsize, -1, ZOO_EPHEMERAL); }
+    else if (p == NULL || p->valsize != e->valsize || memcmp(p->value, e->value, e->valsize) != 0)
+    { rc = __tbm_zkchild(mh, b, client, e); }
   }
 
-  rc  = -1;
-  zrc = zoo_get(mh->zh, path, 0, buffer, &r_bufsize, NULL);
-  if (zrc != ZOK)
+  for (k=0; rc == 0 && k<tractorbeam_fanout_count(published); k+=1)
   {
-    TB_DEBUG("error retrieving contents of: %s/%s", ppath, name);
-    goto handle_error;
+    const tractorbeam_fanout_entry_t *p = tractorbeam_fanout_entry(published, k);
+    if (tractorbeam_fanout_find(current, p->key) == NULL && __tbm_haschild(children, p->key))
+    { rc = __tbm_batch_push(b, TBM_OP_DELETE, mh->znode, p->key, NULL, 0, -1, 0); }
   }
 
-  rc      = -2;
-  *status = callback(ITEM, ppath, name, buffer, (size_t) r_bufsize, data);
-  if (*status != 0)
+  return(rc == 0 ? __tbm_commit(mh, b) : -1);
+}
+
+static
+long __tbm_throttle(tractorbeam_monitor_t *mh)
+{
+  struct timespec ts;
+  if (mh->ratelimit == NULL)
+  { return(0); }
+
+  tractorbeam_ratelimit_acquire(mh->ratelimit);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec * 1000000L + ts.tv_nsec / 1000L);
+}
+
+static
+void __tbm_account(tractorbeam_monitor_t *mh, long started, size_t bytes)
+{
+  struct timespec ts;
+  if (mh->ratelimit == NULL)
+  { return; }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  tractorbeam_ratelimit_release(mh->ratelimit, bytes, ts.tv_sec * 1000000L + ts.tv_nsec / 1000L - started);
+}
+
+static
+int __tbm_reserve(tractorbeam_monitor_t *mh, size_t pathsize, size_t depth)
+{
+  if (pathsize > mh->pathcap)
   {
-    TB_DEBUG("callback has failed: %s/%s/%d", ppath, name, *status);
-    goto handle_error;
+    size_t cap = (mh->pathcap == 0) ? 256 : mh->pathcap;
+    while (cap < pathsize)
+    { cap *= 2; }
+    char *tmp = (char *) realloc(mh->path, cap);
+    if (tmp == NULL)
+    { return(-1); }
+    mh->path    = tmp;
+    mh->pathcap = cap;
   }
 
-  for (int k=0; k<children.count; k+=1)
+  if (depth > mh->stackcap)
   {
-    rc = __tbm_snapshot(mh, path, children.data[k], status, buffer, bufsize, callback, data);
-    if (rc != 0)
-    { goto handle_error; }
+    size_t cap = (mh->stackcap == 0) ? 16 : mh->stackcap * 2;
+    tbm_frame_t *tmp = (tbm_frame_t *) realloc(mh->stack, cap * sizeof(tbm_frame_t));
+    if (tmp == NULL)
+    { return(-1); }
+    mh->stack    = tmp;
+    mh->stackcap = cap;
+  }
+
+  return(0);
+}
+
+/* Moves the names into a spool, releasing each one right away, so
+ * that only the names not yet visited are kept (in memory while the
+ * budget allows).
+ */
+static
+tractorbeam_spool_t *__tbm_spool(tractorbeam_monitor_t *mh, struct String_vector *names)
+{
+  tractorbeam_spool_t *spool = tractorbeam_spool_init(&mh->namebudget, TBM_NAMES_BATCH, mh->sorted);
+  for (int k=0; spool != NULL && k<names->count; k+=1)
+  {
+    if (tractorbeam_spool_push(spool, names->data[k], strlen(names->data[k])) != 0)
+    { break; }
+    free(names->data[k]);
+    names->data[k] = NULL;
+  }
+  deallocate_String_vector(names);
+
+  if (spool != NULL && tractorbeam_spool_seal(spool) != 0)
+  {
+    tractorbeam_spool_term(spool);
+    spool = NULL;
+  }
+  return(spool);
+}
+
+/* Visits the node named `name' whose parent path is the first
+ * `pathlen' bytes of mh->path. On success mh->path holds the path of
+ * this node and its children are returned. Nodes the filter rejects
+ * cost no requests and 1 is returned; nodes it only lists are given
+ * to the callback without contents.
+ */
+static
+int __tbm_visit(tractorbeam_monitor_t *mh, size_t pathlen, const char *name, size_t depth, tractorbeam_spool_t **spool, int *status, tb_snapshot_fn callback, void *data)
+{
+  struct String_vector children;
+  struct Stat stat;
+  tb_stat_t tbstat;
+  int zrc, fetch;
+  long started;
+  size_t namesize = 0;
+  size_t namelen  = strlen(name);
+  int r_bufsize   = 0;
+  char *path      = mh->path;
+  int filter      = TB_FILTER_LIST | TB_FILTER_FETCH;
+
+  path[pathlen] = '/';
+  memcpy(path+pathlen+1, name, namelen + 1);
+
+  if (mh->filter != NULL && (filter = tractorbeam_filter_check(mh->filter, path, depth)) == 0)
+  { return(1); }
+
+  TB_DEBUG("__tbm_snapshot: %.*s,%s => %s", (int) pathlen, path, name, path);
+  children.count  = 0;
+  children.data   = NULL;
+  memset(&stat, 0, sizeof(stat));
+  if (filter & TB_FILTER_LIST)
+  {
+    started = __tbm_throttle(mh);
+    if (mh->changefn == NULL)
+    { zrc = zoo_get_children2(mh->zh, path, 0, &children, &stat); }
+    else
+    { zrc = zoo_wget_children2(mh->zh, path, __tbm_changewatcher, mh, &children, &stat); }
+    if (zrc != ZOK)
+    {
+      TB_DEBUG("error listing children of: %s", path);
+      return(-1);
+    }
+    for (int k=0; k<children.count; k+=1)
+    { namesize += strlen(children.data[k]); }
+    __tbm_account(mh, started, namesize);
+  }
+  else if (mh->datamode != MONITOR_DATA_ALL)
+  {
+    started = __tbm_throttle(mh);
+    if (mh->changefn == NULL)
+    { zrc = zoo_exists(mh->zh, path, 0, &stat); }
+    else
+    { zrc = zoo_wexists(mh->zh, path, __tbm_changewatcher, mh, &stat); }
+    if (zrc != ZOK)
+    {
+      TB_DEBUG("error retrieving stat of: %s", path);
+      return(-1);
+    }
+    __tbm_account(mh, started, 0);
+  }
+  fetch = (filter & TB_FILTER_FETCH)
+       && (mh->datamode == MONITOR_DATA_ALL
+           || (mh->datamode == MONITOR_DATA_LAZY && (stat.numChildren == 0 || (size_t) stat.dataLength < mh->lazylimit)));
+
+  *spool = __tbm_spool(mh, &children);
+  if (*spool == NULL)
+  {
+    TB_DEBUG("error storing children of: %s", path);
+    return(-1);
+  }
+
+  /* the buffer is sized after the stat, but the node may change
+   * between requests, so truncated reads get retried */
+  for (int k=0; ; k+=1)
+  {
+    // callbacks always get a buffer, even if empty
+    size_t need = (fetch && stat.dataLength > 0) ? (size_t) stat.dataLength : 1;
+    if (tbh_grow(&mh->buffer, &mh->bufcap, need, TBM_BUFFER_MIN, mh->buflimit) != 0)
+    {
+      TB_DEBUG("contents too large: %s/%d", path, stat.dataLength);
+      goto handle_error;
+    }
+    if (! fetch)
+    { break; }
+
+    r_bufsize = (int) mh->bufcap;
+    started   = __tbm_throttle(mh);
+    if (mh->changefn == NULL)
+    { zrc = zoo_get(mh->zh, path, 0, mh->buffer, &r_bufsize, &stat); }
+    else
+    { zrc = zoo_wget(mh->zh, path, __tbm_changewatcher, mh, mh->buffer, &r_bufsize, &stat); }
+    if (zrc != ZOK)
+    {
+      TB_DEBUG("error retrieving contents of: %s", path);
+      goto handle_error;
+    }
+    if (r_bufsize < 0)
+    { r_bufsize = 0; }
+    __tbm_account(mh, started, (size_t) r_bufsize);
+
+    if (stat.dataLength <= r_bufsize)
+    { break; }
+    if (k == TBM_GET_RETRIES)
+    {
+      TB_DEBUG("contents keep changing: %s", path);
+      goto handle_error;
+    }
+  }
+
+  tbstat.czxid           = stat.czxid;
+  tbstat.mzxid           = stat.mzxid;
+  tbstat.pzxid           = stat.pzxid;
+  tbstat.ctime           = stat.ctime;
+  tbstat.mtime           = stat.mtime;
+  tbstat.version         = stat.version;
+  tbstat.cversion        = stat.cversion;
+  tbstat.aversion        = stat.aversion;
+  tbstat.ephemeral_owner = stat.ephemeralOwner;
+  tbstat.data_length     = stat.dataLength;
+  tbstat.num_children    = stat.numChildren;
+
+  path[pathlen] = '\0';
+  *status       = callback(ITEM, path, name, mh->buffer, (size_t) r_bufsize, &tbstat, data);
+  path[pathlen] = '/';
+  if (*status != 0)
+  {
+    TB_DEBUG("callback has failed: %s/%d", path, *status);
+    goto handle_error;
   }
 
-  free(path);
   return(0);
 
 handle_error:
-  free(path);
+  tractorbeam_spool_term(*spool);
   return(-1);
 }
 
+/* Walks the tree depth-first using an explicit stack. All paths are
+ * built in place in mh->path, which is reused across snapshots, and
+ * the children names are released as soon as they get visited (see
+ * __tbm_spool).
+ */
+static
+int __tbm_snapshot(tractorbeam_monitor_t *mh, const char *ppath, const char *name, int *status, tb_snapshot_fn callback, void *data)
+{
+  size_t depth   = 0;
+  size_t pathlen = strlen(ppath);
+  size_t namelen = strlen(name);
+  int rc         = -1;
+  int visited;
+
+  if (__tbm_reserve(mh, pathlen + namelen + 2, 1) != 0)
+  { return(-1); }
+  memcpy(mh->path, ppath, pathlen + 1);
+
+  mh->namebudget = mh->namememory;
+  visited        = __tbm_visit(mh, pathlen, name, 0, &mh->stack[0].children, status, callback, data);
+  if (visited != 0)
+  { return((visited == 1) ? 0 : -1); }
+  mh->stack[0].pathlen = (pathlen + namelen == 0) ? 0 : pathlen + namelen + 1;
+  depth                = 1;
+
+  while (depth > 0)
+  {
+    tbm_frame_t *frame = &mh->stack[depth-1];
+    pathlen            = frame->pathlen;
+    name               = tractorbeam_spool_next(frame->children, &namelen);
+    if (name == NULL)
+    {
+      if (tractorbeam_spool_error(frame->children))
+      { goto handle_error; }
+      tractorbeam_spool_term(frame->children);
+      depth -= 1;
+      continue;
+    }
+
+    if (__tbm_reserve(mh, pathlen + namelen + 2, depth + 1) != 0)
+    { goto handle_error; }
+
+    frame = &mh->stack[depth];
+    visited = __tbm_visit(mh, pathlen, name, depth, &frame->children, status, callback, data);
+    if (visited == 1)
+    { continue; }
+    else if (visited != 0)
+    { goto handle_error; }
+    frame->pathlen = pathlen + namelen + 1;
+    depth         += 1;
+  }
+  rc = 0;
+
+handle_error:
+  while (depth > 0)
+  {
+    tractorbeam_spool_term(mh->stack[depth-1].children);
+    depth -= 1;
+  }
+  return(rc);
+}
+
 tractorbeam_monitor_t *tractorbeam_monitor_init(const char *endpoint, const char *znode, int timeout_in_ms)
 {
   tractorbeam_monitor_t *mh = (tractorbeam_monitor_t *) malloc(sizeof(tractorbeam_monitor_t));
   if (mh == NULL)
   { goto handle_error; }
 
-  mh->zh       = NULL;
-  mh->znode    = NULL;
-  mh->timeout  = timeout_in_ms;
-  mh->endpoint = NULL;
+  mh->zh         = NULL;
+  mh->znode      = NULL;
+  mh->timeout    = timeout_in_ms;
+  mh->endpoint   = NULL;
+  mh->payload    = NULL;
+  mh->paysize    = 0;
+  mh->paycap     = 0;
+  mh->haspayload = 0;
+  mh->expired    = 0;
+  mh->state      = ZOO_CONNECTING_STATE;
+  mh->reconnect  = 0;
+  mh->heal       = 0;
+  mh->closing    = 0;
+  mh->backoff    = TBM_BACKOFF_MIN;
+  mh->threaded   = 0;
+  mh->ratelimit  = NULL;
+  mh->filter     = NULL;
+  mh->datamode   = MONITOR_DATA_ALL;
+  mh->lazylimit  = 0;
+  mh->path       = NULL;
+  mh->pathcap    = 0;
+  mh->stack      = NULL;
+  mh->stackcap   = 0;
+  mh->namebudget = 0;
+  mh->namememory = TBM_NAMES_MEMORY;
+  mh->sorted     = 0;
+  mh->buffer     = NULL;
+  mh->bufcap     = 0;
+  mh->buflimit   = TBM_BUFFER_LIMIT;
+  mh->batch      = NULL;
+  mh->changefn   = NULL;
+  mh->changedata = NULL;
+  mh->seed       = (unsigned int) time(NULL) ^ (unsigned int) getpid();
 
   if (pthread_mutex_init(&mh->mutex, NULL) != 0)
   {
@@ -181,6 +991,30 @@ tractorbeam_monitor_t *tractorbeam_monitor_init(const char *endpoint, const char
     return(NULL);
   }
 
+  if (pthread_mutex_init(&mh->pmutex, NULL) != 0)
+  {
+    pthread_mutex_destroy(&mh->mutex);
+    free(mh);
+    return(NULL);
+  }
+
+  if (pthread_mutex_init(&mh->smutex, NULL) != 0)
+  {
+    pthread_mutex_destroy(&mh->pmutex);
+    pthread_mutex_destroy(&mh->mutex);
+    free(mh);
+    return(NULL);
+  }
+
+  if (pthread_cond_init(&mh->scond, NULL) != 0)
+  {
+    pthread_mutex_destroy(&mh->smutex);
+    pthread_mutex_destroy(&mh->pmutex);
+    pthread_mutex_destroy(&mh->mutex);
+    free(mh);
+    return(NULL);
+  }
+
   mh->znode = tbh_strdup(znode);
   if (mh->znode == NULL)
   { goto handle_error; }
@@ -190,6 +1024,9 @@ tractorbeam_monitor_t *tractorbeam_monitor_init(const char *endpoint, const char
   { goto handle_error; }
 
   __tbm_reconnect(mh, __tbm_watcher);
+  if (pthread_create(&mh->reconnector, NULL, __tbm_reconnector, mh) != 0)
+  { goto handle_error; }
+  mh->threaded = 1;
   return(mh);
 
 handle_error:
@@ -197,11 +1034,126 @@ handle_error:
   return(NULL);
 }
 
+int tractorbeam_monitor_wait(tractorbeam_monitor_t *mh, int timeout_in_ms)
+{
+  struct timespec deadline;
+  int rc = 0, code;
+
+  __tbm_deadline(&deadline, timeout_in_ms);
+  if (pthread_mutex_lock(&mh->smutex) != 0)
+  { return(-1); }
+
+  while (rc == 0 && mh->state != ZOO_CONNECTED_STATE)
+  { rc = pthread_cond_timedwait(&mh->scond, &mh->smutex, &deadline); }
+  code = (mh->state == ZOO_CONNECTED_STATE) ? 0 : 1;
+
+  pthread_mutex_unlock(&mh->smutex);
+  return(code);
+}
+
 int tractorbeam_monitor_update(tractorbeam_monitor_t *mh, const void *data, size_t datasize)
 {
-  struct Stat stat;
+  int code = -1;
+
+  __tbm_cache(mh, data, datasize);
+  if (tractorbeam_monitor_wait(mh, mh->timeout) != 0)
+  { return(1); }
+
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  { return(-1); }
+
+  if (mh->zh == NULL)
+  { code = 1; }
+  else
+  { code = __tbm_zkwrite(mh, data, datasize); }
+ 
+  pthread_mutex_unlock(&mh->mutex);
+
+  // the znode (and its watch) is in place, nothing left to restore
+  if (code == 0 && pthread_mutex_lock(&mh->smutex) == 0)
+  {
+    mh->heal = 0;
+    pthread_mutex_unlock(&mh->smutex);
+  }
+  return(code);
+}
+
+tractorbeam_batch_t *tractorbeam_batch_init(void)
+{
+  tractorbeam_batch_t *b = (tractorbeam_batch_t *) malloc(sizeof(tractorbeam_batch_t));
+  if (b != NULL)
+  {
+    b->ops     = NULL;
+    b->count   = 0;
+    b->cap     = 0;
+    b->zops    = NULL;
+    b->results = NULL;
+    b->zcap    = 0;
+  }
+  return(b);
+}
+
+int tractorbeam_batch_create(tractorbeam_batch_t *b, const char *path, const void *data, size_t datasize, int ephemeral)
+{ return(__tbm_batch_push(b, TBM_OP_CREATE, path, NULL, data, datasize, -1, ephemeral ? ZOO_EPHEMERAL : 0)); }
+
+int tractorbeam_batch_set(tractorbeam_batch_t *b, const char *path, const void *data, size_t datasize, int version)
+{ return(__tbm_batch_push(b, TBM_OP_SET, path, NULL, data, datasize, version, 0)); }
+
+int tractorbeam_batch_delete(tractorbeam_batch_t *b, const char *path, int version)
+{ return(__tbm_batch_push(b, TBM_OP_DELETE, path, NULL, NULL, 0, version, 0)); }
+
+int tractorbeam_batch_check(tractorbeam_batch_t *b, const char *path, int version)
+{ return(__tbm_batch_push(b, TBM_OP_CHECK, path, NULL, NULL, 0, version, 0)); }
+
+size_t tractorbeam_batch_count(const tractorbeam_batch_t *b)
+{ return(b->count); }
+
+void tractorbeam_batch_clear(tractorbeam_batch_t *b)
+{
+  size_t k;
+  for (k=0; k<b->count; k+=1)
+  { free(b->ops[k].path); }
+  b->count = 0;
+}
+
+void tractorbeam_batch_term(tractorbeam_batch_t *b)
+{
+  if (b != NULL)
+  {
+    tractorbeam_batch_clear(b);
+    free(b->ops);
+    free(b->zops);
+    free(b->results);
+    free(b);
+  }
+}
+
+int tractorbeam_monitor_commit(tractorbeam_monitor_t *mh, tractorbeam_batch_t *b)
+{
+  int code = -1;
+  if (tractorbeam_monitor_wait(mh, mh->timeout) != 0)
+  { return(1); }
+
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  { return(-1); }
+
+  if (mh->zh == NULL)
+  { code = 1; }
+  else
+  { code = __tbm_commit(mh, b); }
+
+  pthread_mutex_unlock(&mh->mutex);
+  return(code);
+}
+
+int tractorbeam_monitor_fanout(tractorbeam_monitor_t *mh, const tractorbeam_fanout_t *published, const tractorbeam_fanout_t *current)
+{
+  struct String_vector children;
   int rc, code = -1;
 
+  if (tractorbeam_monitor_wait(mh, mh->timeout) != 0)
+  { return(1); }
+
   if (pthread_mutex_lock(&mh->mutex) != 0)
   { return(-1); }
 
@@ -209,50 +1161,169 @@ int tractorbeam_monitor_update(tractorbeam_monitor_t *mh, const void *data, size
   { code = 1; }
   else
   {
-    rc = zoo_exists(mh->zh, mh->znode, 0, &stat);
+    rc = zoo_get_children(mh->zh, mh->znode, 0, &children);
     if (rc == ZNONODE)
-    { code = __tbm_zkcreate(mh, data, datasize); }
+    {
+      TB_DEBUG("znode does not exist: %s", mh->znode);
+      code = -2;
+    }
     else if (rc == ZOK)
     {
-      code = __tbm_zkcheck(mh, &stat);
-      if (code == 0)
-      { code = __tbm_zkupdate(mh, &stat, data, datasize); }
+      code = __tbm_zkfanout(mh, &children, published, current);
+      deallocate_String_vector(&children);
     }
-    else
-    { code = -1; }
   }
- 
+
   pthread_mutex_unlock(&mh->mutex);
 
   return(code);
 }
 
+int tractorbeam_monitor_ratelimit(tractorbeam_monitor_t *mh, int max_rps, long max_bps, int target_latency_in_ms)
+{
+  tractorbeam_ratelimit_t *rl = NULL;
+  if (max_rps > 0 || max_bps > 0)
+  {
+    rl = tractorbeam_ratelimit_init(max_rps, max_bps, target_latency_in_ms);
+    if (rl == NULL)
+    { return(-1); }
+  }
+
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  {
+    if (rl != NULL)
+    { tractorbeam_ratelimit_term(rl); }
+    return(-1);
+  }
+  if (mh->ratelimit != NULL)
+  { tractorbeam_ratelimit_term(mh->ratelimit); }
+  mh->ratelimit = rl;
+  pthread_mutex_unlock(&mh->mutex);
+
+  return(0);
+}
+
+int tractorbeam_monitor_filter(tractorbeam_monitor_t *mh, char * const *includes, int nincludes, char * const *excludes, int nexcludes, int max_depth)
+{
+  tractorbeam_filter_t *f = NULL;
+  if (nincludes > 0 || nexcludes > 0 || max_depth >= 0)
+  {
+    f = tractorbeam_filter_init(includes, nincludes, excludes, nexcludes, max_depth);
+    if (f == NULL)
+    { return(-1); }
+  }
+
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  {
+    if (f != NULL)
+    { tractorbeam_filter_term(f); }
+    return(-1);
+  }
+  if (mh->filter != NULL)
+  { tractorbeam_filter_term(mh->filter); }
+  mh->filter = f;
+  pthread_mutex_unlock(&mh->mutex);
+
+  return(0);
+}
+
+void tractorbeam_monitor_buffer(tractorbeam_monitor_t *mh, size_t limit)
+{
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  { return; }
+
+  mh->buflimit = limit;
+  if (mh->bufcap > limit)
+  {
+    free(mh->buffer);
+    mh->buffer = NULL;
+    mh->bufcap = 0;
+  }
+
+  pthread_mutex_unlock(&mh->mutex);
+}
+
+void tractorbeam_monitor_names(tractorbeam_monitor_t *mh, size_t max_memory, int sorted)
+{
+  mh->namememory = max_memory;
+  mh->sorted     = sorted;
+}
+
+void tractorbeam_monitor_data(tractorbeam_monitor_t *mh, tb_monitor_data_e mode, size_t lazy_limit)
+{
+  mh->datamode  = mode;
+  mh->lazylimit = lazy_limit;
+}
+
+void tractorbeam_monitor_watch(tractorbeam_monitor_t *mh, tb_change_fn callback, void *data)
+{
+  mh->changedata = data;
+  mh->changefn   = callback;
+}
+
+int tractorbeam_monitor_rebalance(tractorbeam_monitor_t *mh)
+{
+  char *endpoint = tractorbeam_probe_sort(mh->endpoint, TBP_TIMEOUT);
+  if (endpoint == NULL)
+  { return(-1); }
+
+  size_t headlen = strcspn(endpoint, ",/");
+  if (strncmp(endpoint, mh->endpoint, headlen) == 0 && strchr(",/", mh->endpoint[headlen]) != NULL)
+  {
+    free(endpoint);
+    return(0);
+  }
+
+  if (pthread_mutex_lock(&mh->mutex) != 0)
+  {
+    free(endpoint);
+    return(-1);
+  }
+  char *tmp    = mh->endpoint;
+  mh->endpoint = endpoint;
+  pthread_mutex_unlock(&mh->mutex);
+  free(tmp);
+
+  // the new session behaves as one replacing an expired session: the
+  // znode gets restored and the watch callback gets called
+  TB_DEBUG("rebalancing session: %s", endpoint);
+  mh->expired = 1;
+  __tbm_reconnect(mh, __tbm_watcher);
+  return(1);
+}
+
 int tractorbeam_monitor_snapshot(tractorbeam_monitor_t *mh, const char *path, tb_snapshot_fn callback, void *data)
 {
+  if (tractorbeam_monitor_wait(mh, mh->timeout) != 0)
+  {
+    TB_DEBUG("not connected; giving up snapshot: %s", path);
+    return(callback(FAIL, path, "", NULL, 0, NULL, data));
+  }
+
   if (pthread_mutex_lock(&mh->mutex) != 0)
   { return(-1); }
 
   int status;
-  char *buffer = (char *) malloc(1048576);
   char *path1  = tbh_strdup(path);
   char *path2  = tbh_strdup(path);
   char *ppath  = (path1 == NULL) ? NULL : dirname(path1);
   char *name   = (path2 == NULL) ? NULL : basename(path2);
   int rc       = -1;
 
-  if (ppath != NULL && name != NULL && buffer != NULL)
+  if (ppath != NULL && name != NULL)
   {
-    if (strcmp(ppath, "/") == 0)
-    { rc = __tbm_snapshot(mh, "", name, &status, buffer, 1048576, callback, data); }
+    if (strcmp(name, "/") == 0)
+    { rc = __tbm_snapshot(mh, "", "", &status, callback, data); }
+    else if (strcmp(ppath, "/") == 0)
+    { rc = __tbm_snapshot(mh, "", name, &status, callback, data); }
     else
-    { rc = __tbm_snapshot(mh, ppath, name, &status, buffer, 1048576, callback, data); }
+    { rc = __tbm_snapshot(mh, ppath, name, &status, callback, data); }
   }
   if (rc == 0)
-  { status = callback(DONE, path, "", NULL, 0, data); }
+  { status = callback(DONE, path, "", NULL, 0, NULL, data); }
   else if (rc == -1)
-  { status = callback(FAIL, path, "", NULL, 0, data); }
+  { status = callback(FAIL, path, "", NULL, 0, NULL, data); }
 
-  free(buffer);
   free(path1);
   free(path2);
 
@@ -263,6 +1334,10 @@ int tractorbeam_monitor_snapshot(tractorbeam_monitor_t *mh, const char *path, tb
 int tractorbeam_monitor_delete(tractorbeam_monitor_t *mh)
 {
   int code = -1;
+  __tbm_forget(mh);
+  if (tractorbeam_monitor_wait(mh, mh->timeout) != 0)
+  { return(1); }
+
   if (pthread_mutex_lock(&mh->mutex) != 0)
   { return(-1); }
 
@@ -283,6 +1358,14 @@ int tractorbeam_monitor_delete(tractorbeam_monitor_t *mh)
 
 int tractorbeam_monitor_term(tractorbeam_monitor_t *mh)
 {
+  if (mh->threaded && pthread_mutex_lock(&mh->smutex) == 0)
+  {
+    mh->closing = 1;
+    pthread_cond_broadcast(&mh->scond);
+    pthread_mutex_unlock(&mh->smutex);
+    pthread_join(mh->reconnector, NULL);
+  }
+
   if (pthread_mutex_lock(&mh->mutex) != 0)
   { return(-1); }
 
@@ -295,7 +1378,19 @@ int tractorbeam_monitor_term(tractorbeam_monitor_t *mh)
   { zookeeper_close(zh); }
   free(mh->znode);
   free(mh->endpoint);
+  free(mh->payload);
+  free(mh->path);
+  free(mh->stack);
+  free(mh->buffer);
+  tractorbeam_batch_term(mh->batch);
+  if (mh->ratelimit != NULL)
+  { tractorbeam_ratelimit_term(mh->ratelimit); }
+  if (mh->filter != NULL)
+  { tractorbeam_filter_term(mh->filter); }
   pthread_mutex_destroy(&mutex);
+  pthread_mutex_destroy(&mh->pmutex);
+  pthread_mutex_destroy(&mh->smutex);
+  pthread_cond_destroy(&mh->scond);
   free(mh);
 
   return(0);
@@ -29,9 +29,13 @@
 #define __tractorbeam_monitor_h__
 
 #include <stdlib.h>
+#include <stdint.h>
+#include "tractorbeam/fanout.h"
 
 typedef struct tractorbeam_monitor_t tractorbeam_monitor_t;
 
+typedef struct tractorbeam_batch_t tractorbeam_batch_t;
+
 typedef enum
 {
   ITEM,
@@ -39,6 +43,30 @@ typedef enum
   FAIL
 } tb_snapshot_events;
 
+typedef enum
+{
+  MONITOR_DATA_ALL,
+  MONITOR_DATA_NONE,
+  MONITOR_DATA_LAZY
+} tb_monitor_data_e;
+
+/*! The metadata of a node (see the zookeeper Stat).
+ */
+typedef struct
+{
+  int64_t czxid;
+  int64_t mzxid;
+  int64_t pzxid;
+  int64_t ctime;
+  int64_t mtime;
+  int32_t version;
+  int32_t cversion;
+  int32_t aversion;
+  int64_t ephemeral_owner;
+  int32_t data_length;
+  int32_t num_children;
+} tb_stat_t;
+
 /*! tractorbeam_monitor_snapshot callback.
  *
  * This function gets called for every node found in along the
@@ -57,11 +85,24 @@ typedef enum
  * \param contents The contents of the node (might be NULL);
  *
  * param contsize The size of the data pointer (0 if data is NULL);
+ *
+ * \param stat The metadata of the current node. This is NULL when
+ *             event is DONE or FAIL, or when it is not known (e.g.
+ *             when reading from files). Contents that have not been
+ *             read (see tractorbeam_monitor_data) come empty, but
+ *             stat->data_length still tells their size;
  * 
  * \return 0: continue;
  *         else: aborts the function;
  */
-typedef int (*tb_snapshot_fn)(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, void *data);
+typedef int (*tb_snapshot_fn)(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data);
+
+/*! tractorbeam_monitor_watch callback.
+ *
+ * This runs on the zookeeper completion thread: it must return
+ * quickly and must not call any function of this monitor.
+ */
+typedef void (*tb_change_fn)(void *data);
 
 /*! Initialize the monitor.
  *
@@ -83,11 +124,33 @@ typedef int (*tb_snapshot_fn)(tb_snapshot_events event, const char *ppath, const
  */
 tractorbeam_monitor_t *tractorbeam_monitor_init(const char *zk_endpoint, const char *znode, int timeout_in_ms);
 
+/*! Waits until the monitor has an established zookeeper session.
+ *
+ * The monitor tracks the connection state from session events and
+ * reconnects by itself (using exponential backoff with jitter) after
+ * the session expires. The functions below already wait for at most
+ * the session timeout before issuing any request.
+ *
+ * \param timeout_in_ms How long to wait at most;
+ *
+ * \return 0: connected;
+ *
+ * \return 1: not connected after timeout_in_ms;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_monitor_wait(tractorbeam_monitor_t *, int timeout_in_ms);
+
 /*! Writes data onto the znode.
  *
  * This function shall create or set the znode on zookeeper with the
  * given data.
  *
+ * The data is also kept by the monitor, which watches the znode and
+ * recreates it with this payload as soon as it gets removed or the
+ * session is re-established after expiration. Attempts that fail
+ * are retried (with backoff) until the znode is back.
+ *
  * \param data The data you want to write. May be NULL, in which case
  *             the data gets deleted (the znode continues, though);
  *
@@ -96,7 +159,10 @@ tractorbeam_monitor_t *tractorbeam_monitor_init(const char *zk_endpoint, const c
  *
  * \return 0: success;
  *
- * \return 1: you must retry the operation (an stale ephemeral node has been deleted, for instance);
+ * \return 1: you must retry the operation (there is no session or
+ *            the znode has changed concurrently, for instance). A
+ *            stale ephemeral node, left by a previous session, is
+ *            replaced right away;
  *
  * \return -2: could not create/update the znode;
  *
@@ -104,11 +170,207 @@ tractorbeam_monitor_t *tractorbeam_monitor_init(const char *zk_endpoint, const c
  */
 int tractorbeam_monitor_update(tractorbeam_monitor_t *, const void *data, size_t datasize);
 
+/*! Writes each entry as an ephemeral child of the znode.
+ *
+ * The znode itself must exist (and should not be ephemeral). Only
+ * the entries missing on zookeeper or whose value differs from the
+ * published one get written, and the published entries that are no
+ * longer current get deleted, in a single multi request. Children
+ * lost (removed by someone else or by a session expiration) are
+ * restored on the next call, and children left by another session
+ * (e.g. before a restart) are replaced rather than set, so that they
+ * do not go away along with that session.
+ *
+ * \param published The entries written by the last successful call
+ *                  (empty on the first call);
+ *
+ * \param current The entries to publish;
+ *
+ * \return 0: success (current is now the published set);
+ *
+ * \return 1: you must retry the operation (nothing has been written);
+ *
+ * \return -2: the znode does not exist;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_monitor_fanout(tractorbeam_monitor_t *, const tractorbeam_fanout_t *published, const tractorbeam_fanout_t *current);
+
+/*! Creates an empty batch of operations.
+ *
+ * Operations are accumulated (paths and data get copied) and then
+ * applied atomically, in a single round trip, by
+ * tractorbeam_monitor_commit. The batch may be reused after
+ * tractorbeam_batch_clear.
+ *
+ * \return The batch or NULL if there was any error;
+ */
+tractorbeam_batch_t *tractorbeam_batch_init(void);
+
+/*! Adds a create operation (acl is OPEN_UNSAFE).
+ *
+ * \param data The data of the new znode (may be NULL);
+ *
+ * \param ephemeral When true the znode is ephemeral;
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_batch_create(tractorbeam_batch_t *, const char *path, const void *data, size_t datasize, int ephemeral);
+
+/*! Adds a set operation, which only succeeds if the znode has the given
+ *  version (-1 matches any version).
+ */
+int tractorbeam_batch_set(tractorbeam_batch_t *, const char *path, const void *data, size_t datasize, int version);
+
+/*! Adds a delete operation, which only succeeds if the znode has the
+ *  given version (-1 matches any version).
+ */
+int tractorbeam_batch_delete(tractorbeam_batch_t *, const char *path, int version);
+
+/*! Adds a check operation, which makes the whole batch fail unless the
+ *  znode has the given version.
+ */
+int tractorbeam_batch_check(tractorbeam_batch_t *, const char *path, int version);
+
+/*! The number of operations in the batch.
+ */
+size_t tractorbeam_batch_count(const tractorbeam_batch_t *);
+
+/*! Removes all operations from the batch.
+ */
+void tractorbeam_batch_clear(tractorbeam_batch_t *);
+
+/*! Free all resources used by this batch.
+ */
+void tractorbeam_batch_term(tractorbeam_batch_t *);
+
+/*! Applies all operations of the batch in a single transaction
+ *  (zoo_multi): either all of them succeed or none is applied.
+ *
+ * The batch is left untouched, so it may be committed again.
+ *
+ * \return 0: success (an empty batch always succeeds);
+ *
+ * \return 1: a check or version did not match, or a znode did (not)
+ *            exist. Nothing has been applied and you should retry
+ *            after reading the current state;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_monitor_commit(tractorbeam_monitor_t *, tractorbeam_batch_t *);
+
+/*! Limits the request rate of tractorbeam_monitor_snapshot.
+ *
+ * See tractorbeam_ratelimit_init. The latency target only has an
+ * effect when at least one of the limits is given.
+ *
+ * \param max_rps Maximum requests per second (0 means no limit);
+ *
+ * \param max_bps Maximum bytes per second (0 means no limit);
+ *
+ * \param target_latency_in_ms Backs off when requests take longer
+ *                             than this (0 disables);
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_monitor_ratelimit(tractorbeam_monitor_t *, int max_rps, long max_bps, int target_latency_in_ms);
+
+/*! Limits the size of the contents read during snapshots.
+ *
+ * Contents are read into a buffer that is sized after each node and
+ * kept across snapshots, growing on demand up to this limit. Nodes
+ * larger than the limit make the snapshot fail (they are never
+ * truncated).
+ *
+ * \param limit The maximum size of the buffer, in bytes [default:1MB];
+ */
+void tractorbeam_monitor_buffer(tractorbeam_monitor_t *, size_t limit);
+
+/*! Bounds the memory used for children names during snapshots.
+ *
+ * Children are visited in batches and their names released as they
+ * get visited. Names beyond max_memory (considering all the levels
+ * being walked) go into temporary files.
+ *
+ * \param max_memory The maximum memory for names, in bytes;
+ *
+ * \param sorted When true children are visited in ascending order,
+ *               sorting with an external merge when they do not fit
+ *               in max_memory;
+ */
+void tractorbeam_monitor_names(tractorbeam_monitor_t *, size_t max_memory, int sorted);
+
+/*! Selects the nodes tractorbeam_monitor_snapshot reads.
+ *
+ * See tractorbeam_filter_init. Patterns are evaluated before any
+ * request is issued for a node, so excluded subtrees cost nothing.
+ * Parents of selected nodes are listed but their contents are not
+ * read, being given to the callback as empty.
+ *
+ * \param max_depth The deepest level to read, relative to the path
+ *                  given to tractorbeam_monitor_snapshot (-1 means no
+ *                  limit);
+ *
+ * \return 0: success;
+ *
+ * \return -1: error (e.g. an invalid pattern);
+ */
+int tractorbeam_monitor_filter(tractorbeam_monitor_t *, char * const *includes, int nincludes, char * const *excludes, int nexcludes, int max_depth);
+
+/*! Chooses which contents tractorbeam_monitor_snapshot reads.
+ *
+ * MONITOR_DATA_NONE reads the metadata only, which comes along with
+ * the children (or from zoo_exists for nodes whose children are not
+ * listed), so it takes a single request per node.
+ * MONITOR_DATA_LAZY reads the contents of leaves and of nodes
+ * smaller than lazy_limit only.
+ *
+ * \param mode The contents to read [default:MONITOR_DATA_ALL];
+ *
+ * \param lazy_limit The size under which MONITOR_DATA_LAZY reads the
+ *                   contents of nodes with children, in bytes;
+ */
+void tractorbeam_monitor_data(tractorbeam_monitor_t *, tb_monitor_data_e mode, size_t lazy_limit);
+
+/*! Moves the session onto the preferred server.
+ *
+ * Probes the servers (see tractorbeam_probe_sort) and reconnects if
+ * the preferred one has changed. The new session is handled like one
+ * replacing an expired session (see tractorbeam_monitor_watch). As
+ * this replaces the session, use it only with monitors that do not
+ * own an ephemeral znode.
+ *
+ * \return 0: the session has not moved;
+ *
+ * \return 1: reconnecting to the preferred server;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_monitor_rebalance(tractorbeam_monitor_t *);
+
+/*! Sets watches on every node visited by tractorbeam_monitor_snapshot.
+ *
+ * The callback gets called once the contents or the children of any
+ * of these nodes change (watches fire only once, so take another
+ * snapshot to get notified again), and when a new session replaces
+ * an expired one.
+ *
+ * \param callback The function to call (NULL disables the watches);
+ */
+void tractorbeam_monitor_watch(tractorbeam_monitor_t *, tb_change_fn callback, void *data);
+
 /*! Walks a given zookeeper tree.
  */
 int tractorbeam_monitor_snapshot(tractorbeam_monitor_t *, const char *path, tb_snapshot_fn callback, void *data);
 
 /*! Deletes the znode from zookeeper;
+ *
+ *  This also discards the payload kept by
+ *  tractorbeam_monitor_update, so the znode is not restored;
  *
  *  \return 0: success;
  *
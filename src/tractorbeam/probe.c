@@ -0,0 +1,277 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <poll.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <zookeeper/zookeeper.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/probe.h"
+#include "tractorbeam/helpers.h"
+
+#define TBP_DEFAULT_PORT "2181"
+#define TBP_UNREACHABLE 0x7fffffff
+
+typedef struct
+{
+  const char *server;
+  int observer;
+  int latency;
+  int timeout;
+  pthread_t thread;
+  int threaded;
+} tbp_server_t;
+
+static
+long __tbp_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec * 1000L + ts.tv_nsec / 1000000L);
+}
+
+static
+int __tbp_poll(int fd, short events, long deadline)
+{
+  struct pollfd pfd;
+  long remaining = deadline - __tbp_now();
+  int rc;
+
+  pfd.fd      = fd;
+  pfd.events  = events;
+  pfd.revents = 0;
+  if (remaining <= 0)
+  { return(0); }
+
+  do
+  { rc = poll(&pfd, 1, (int) remaining); } while (rc == -1 && errno == EINTR);
+  return(rc > 0);
+}
+
+static
+int __tbp_connect(const char *host, const char *port, long deadline)
+{
+  struct addrinfo hints, *addrs, *ai;
+  int fd = -1;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, port, &hints, &addrs) != 0)
+  { return(-1); }
+
+  for (ai = addrs; ai != NULL && fd == -1; ai = ai->ai_next)
+  {
+    int err         = 0;
+    socklen_t errsz = sizeof(err);
+
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd == -1)
+    { continue; }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+    { break; }
+
+    if (errno != EINPROGRESS ||
+        ! __tbp_poll(fd, POLLOUT, deadline) ||
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errsz) != 0 ||
+        err != 0)
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  freeaddrinfo(addrs);
+  return(fd);
+}
+
+static
+void *__tbp_probe(void *ctx)
+{
+  tbp_server_t *server = (tbp_server_t *) ctx;
+  char buffer[1024];
+  char host[256];
+  const char *port    = TBP_DEFAULT_PORT;
+  const char *sep     = strrchr(server->server, ':');
+  const char *bracket = strchr(server->server, ']');
+  size_t hostlen      = (sep == NULL || (bracket != NULL && bracket > sep)) ? strlen(server->server) : (size_t) (sep - server->server);
+  size_t offset       = 0;
+  long start          = __tbp_now();
+  long deadline       = start + server->timeout;
+  long firstbyte   = -1;
+  int fd;
+
+  server->observer = 0;
+  server->latency  = TBP_UNREACHABLE;
+  if (hostlen >= sizeof(host))
+  { return(NULL); }
+  if (hostlen < strlen(server->server))
+  { port = sep + 1; }
+  memcpy(host, server->server, hostlen);
+  host[hostlen] = '\0';
+  if (host[0] == '[' && hostlen > 2 && host[hostlen-1] == ']')
+  {
+    memmove(host, host+1, hostlen-2);
+    host[hostlen-2] = '\0';
+  }
+
+  fd = __tbp_connect(host, port, deadline);
+  if (fd == -1)
+  {
+    TB_DEBUG("probe: could not connect: %s", server->server);
+    return(NULL);
+  }
+
+  if (write(fd, "srvr", 4) == 4)
+  {
+    while (offset < sizeof(buffer) - 1 && __tbp_poll(fd, POLLIN, deadline))
+    {
+      ssize_t rc = read(fd, buffer+offset, sizeof(buffer) - 1 - offset);
+      if (rc <= 0)
+      { break; }
+      if (firstbyte == -1)
+      { firstbyte = __tbp_now(); }
+      offset += (size_t) rc;
+    }
+  }
+  close(fd);
+
+  buffer[offset] = '\0';
+  if (firstbyte != -1)
+  {
+    server->latency  = (int) (firstbyte - start);
+    server->observer = (strstr(buffer, "Mode: observer") != NULL);
+  }
+  TB_DEBUG("probe: %s => latency=%d observer=%d", server->server, server->latency, server->observer);
+  return(NULL);
+}
+
+static
+int __tbp_compare(const void *a, const void *b)
+{
+  const tbp_server_t *x = (const tbp_server_t *) a;
+  const tbp_server_t *y = (const tbp_server_t *) b;
+  int xdown = (x->latency == TBP_UNREACHABLE);
+  int ydown = (y->latency == TBP_UNREACHABLE);
+
+  if (xdown != ydown)
+  { return(xdown - ydown); }
+  if (x->observer != y->observer)
+  { return(y->observer - x->observer); }
+  return((x->latency > y->latency) - (x->latency < y->latency));
+}
+
+char *tractorbeam_probe_sort(const char *endpoint, int timeout_in_ms)
+{
+  tbp_server_t *servers = NULL;
+  char *hosts           = tbh_strdup(endpoint);
+  char *chroot          = NULL;
+  char *result          = NULL;
+  char *slash           = NULL;
+  size_t count          = 1;
+  size_t k              = 0;
+
+  if (hosts == NULL)
+  { return(NULL); }
+
+  slash = strchr(hosts, '/');
+  if (slash != NULL)
+  {
+    chroot = tbh_strdup(slash);
+    if (chroot == NULL)
+    { goto handle_error; }
+    *slash = '\0';
+  }
+
+  for (char *p = hosts; *p != '\0'; p += 1)
+  { count += (*p == ','); }
+  servers = (tbp_server_t *) malloc(sizeof(tbp_server_t) * count);
+  if (servers == NULL)
+  { goto handle_error; }
+
+  count = 0;
+  for (char *p = hosts, *q; p != NULL; p = q)
+  {
+    q = strchr(p, ',');
+    if (q != NULL)
+    { *q++ = '\0'; }
+    if (*p == '\0')
+    { continue; }
+    servers[count].server  = p;
+    servers[count].timeout = timeout_in_ms;
+    // one thread per server, so that dead servers are waited for only
+    // once (inline if the thread could not be started)
+    servers[count].threaded = (pthread_create(&servers[count].thread, NULL, __tbp_probe, &servers[count]) == 0);
+    if (! servers[count].threaded)
+    { __tbp_probe(&servers[count]); }
+    count += 1;
+  }
+  for (k=0; k<count; k+=1)
+  {
+    if (servers[k].threaded)
+    { pthread_join(servers[k].thread, NULL); }
+  }
+  qsort(servers, count, sizeof(tbp_server_t), __tbp_compare);
+
+  size_t size = (chroot == NULL) ? 1 : strlen(chroot) + 1;
+  for (k=0; k<count; k+=1)
+  { size += strlen(servers[k].server) + 1; }
+  result = (char *) malloc(size);
+  if (result == NULL)
+  { goto handle_error; }
+
+  result[0] = '\0';
+  for (k=0; k<count; k+=1)
+  {
+    if (k > 0)
+    { strcat(result, ","); }
+    strcat(result, servers[k].server);
+  }
+  if (chroot != NULL)
+  { strcat(result, chroot); }
+
+  zoo_deterministic_conn_order(1);
+
+handle_error:
+  free(servers);
+  free(chroot);
+  free(hosts);
+  return(result);
+}
@@ -0,0 +1,59 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_probe_h__
+#define __tractorbeam_probe_h__
+
+/*! How long to wait for the servers to answer, in milliseconds. This
+ *  is much shorter than a session timeout, as a server that takes
+ *  longer is not worth preferring anyway.
+ */
+#define TBP_TIMEOUT 1000
+
+/*! Reorders a zookeeper connection string by server preference.
+ *
+ * Every server listed gets probed with the `srvr' four letter word,
+ * measuring the time it takes to answer. Servers are probed all at
+ * once, so this takes at most timeout_in_ms regardless of how many
+ * of them are down. Observers come first, then
+ * the remaining servers ordered by latency. Servers that do not
+ * answer go last. The chroot suffix, if any, is preserved.
+ *
+ * This also tells the zookeeper client not to shuffle the servers, so
+ * that the order returned is the order the connections are tried.
+ *
+ * \param endpoint The zookeeper connection string
+ *                 (e.g. "zk01:2181,zk02:2181/chroot");
+ *
+ * \param timeout_in_ms The maximum time to wait (see TBP_TIMEOUT);
+ *
+ * \return The new connection string (use free) or NULL if there was
+ *         any error;
+ */
+char *tractorbeam_probe_sort(const char *endpoint, int timeout_in_ms);
+
+#endif
@@ -0,0 +1,82 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdlib.h>
+#include "tractorbeam/monitor.h"
+#include "tractorbeam/publish.h"
+
+#define __TBPUB_STR(x) #x
+#define __TBPUB_XSTR(x) __TBPUB_STR(x)
+#define TBPUB_VERSION __TBPUB_XSTR(TRACTORBEAM_VERSION_MAJOR) "." \
+                      __TBPUB_XSTR(TRACTORBEAM_VERSION_MINOR) "." \
+                      __TBPUB_XSTR(TRACTORBEAM_VERSION_PATCH)
+
+struct tractorbeam_publisher_t
+{
+  tractorbeam_monitor_t *mh;
+};
+
+const char *tractorbeam_version(void)
+{ return(TBPUB_VERSION); }
+
+tractorbeam_publisher_t *tractorbeam_publisher_init(const char *zk_endpoint, const char *znode, int timeout_in_ms)
+{
+  tractorbeam_publisher_t *ph = (tractorbeam_publisher_t *) malloc(sizeof(tractorbeam_publisher_t));
+  if (ph == NULL)
+  { return(NULL); }
+
+  ph->mh = tractorbeam_monitor_init(zk_endpoint, znode, timeout_in_ms);
+  if (ph->mh == NULL)
+  {
+    free(ph);
+    return(NULL);
+  }
+
+  return(ph);
+}
+
+int tractorbeam_publish(tractorbeam_publisher_t *ph, const void *data, size_t datasize)
+{
+  int rc = tractorbeam_monitor_update(ph->mh, data, datasize);
+  if (rc == -2)
+  { return(-1); }
+  return(rc);
+}
+
+int tractorbeam_unpublish(tractorbeam_publisher_t *ph)
+{ return(tractorbeam_monitor_delete(ph->mh)); }
+
+int tractorbeam_publisher_term(tractorbeam_publisher_t *ph)
+{
+  int rc = 0;
+  if (ph != NULL)
+  {
+    rc = tractorbeam_monitor_term(ph->mh);
+    free(ph);
+  }
+  return(rc);
+}
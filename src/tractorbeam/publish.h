@@ -0,0 +1,120 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_publish_h__
+#define __tractorbeam_publish_h__
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The makefile reads the library version (and the soname) from these
+ * lines. */
+#define TRACTORBEAM_VERSION_MAJOR 1
+#define TRACTORBEAM_VERSION_MINOR 1
+#define TRACTORBEAM_VERSION_PATCH 0
+
+/* The library is built with -fvisibility=hidden: only the functions
+ * declared here are exported. */
+#if defined(__GNUC__) && __GNUC__ >= 4
+# define TRACTORBEAM_API __attribute__((visibility("default")))
+#else
+# define TRACTORBEAM_API
+#endif
+
+typedef struct tractorbeam_publisher_t tractorbeam_publisher_t;
+
+/*! Returns the version of the library (e.g. "1.1.0").
+ *
+ * This may differ from the TRACTORBEAM_VERSION_* macros, which refer
+ * to the headers the program was compiled against.
+ */
+TRACTORBEAM_API const char *tractorbeam_version(void);
+
+/*! Initializes a publisher.
+ *
+ * This is the in-process equivalent of `tractorbeam send`: the
+ * application hands the data it already has in memory, instead of
+ * having tractorbeam running a program to collect it.
+ *
+ * \param zk_endpoint Zookeeper cluster to use;
+ *
+ * \param znode The path of the ephemeral node to create (all the
+ *              parents nodes must exist);
+ *
+ * \param timeout_in_ms Zookeeper session timeout in milliseconds;
+ *
+ * \return The publisher handle or NULL if there was any error;
+ */
+TRACTORBEAM_API tractorbeam_publisher_t *tractorbeam_publisher_init(const char *zk_endpoint, const char *znode, int timeout_in_ms);
+
+/*! Writes data onto the znode, creating it if necessary.
+ *
+ * The data is copied and kept by the publisher, which recreates the
+ * znode by itself when it gets removed or the session expires.
+ *
+ * \param data The data you want to write;
+ *
+ * \param datasize The size of the data param;
+ *
+ * \return 0: success;
+ *
+ * \return 1: the data could not be written yet (no session, for
+ *            instance). It gets written once the session is
+ *            established, but you may also retry;
+ *
+ * \return -1: error;
+ */
+TRACTORBEAM_API int tractorbeam_publish(tractorbeam_publisher_t *, const void *data, size_t datasize);
+
+/*! Removes the znode from zookeeper.
+ *
+ * The data kept by the publisher is discarded as well, so the znode
+ * is only created again by the next tractorbeam_publish.
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+TRACTORBEAM_API int tractorbeam_unpublish(tractorbeam_publisher_t *);
+
+/*! Closes the session (the znode goes away with it) and frees all
+ *  resources used by this publisher.
+ *
+ * \return 0: success;
+ *
+ * \return -1: failure;
+ */
+TRACTORBEAM_API int tractorbeam_publisher_term(tractorbeam_publisher_t *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
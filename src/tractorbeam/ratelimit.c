@@ -0,0 +1,157 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/ratelimit.h"
+
+#define TBR_MIN_SCALE (1.0 / 64)
+#define TBR_RECOVERY (1.0 / 32)
+#define TBR_SMOOTHING 0.2
+
+struct tractorbeam_ratelimit_t
+{
+  double max_rps;
+  double max_bps;
+  double requests;
+  double bytes;
+  double scale;
+  double latency;
+  long target;
+  long backoff_at;
+  long refill_at;
+};
+
+static
+long __tbr_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec * 1000000L + ts.tv_nsec / 1000L);
+}
+
+static
+void __tbr_sleep(long usecs)
+{
+  struct timespec ts;
+  ts.tv_sec  = usecs / 1000000L;
+  ts.tv_nsec = (usecs % 1000000L) * 1000L;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+  { }
+}
+
+static
+double __tbr_fill(double tokens, double rate, double elapsed)
+{
+  double burst = (rate < 1) ? 1 : rate;
+  tokens      += rate * elapsed;
+  return((tokens > burst) ? burst : tokens);
+}
+
+static
+void __tbr_refill(tractorbeam_ratelimit_t *rl)
+{
+  long now       = __tbr_now();
+  double elapsed = (now - rl->refill_at) / 1e6;
+  rl->refill_at  = now;
+  if (rl->max_rps > 0)
+  { rl->requests = __tbr_fill(rl->requests, rl->max_rps * rl->scale, elapsed); }
+  if (rl->max_bps > 0)
+  { rl->bytes = __tbr_fill(rl->bytes, rl->max_bps * rl->scale, elapsed); }
+}
+
+tractorbeam_ratelimit_t *tractorbeam_ratelimit_init(int max_rps, long max_bps, int target_latency_in_ms)
+{
+  tractorbeam_ratelimit_t *rl = (tractorbeam_ratelimit_t *) malloc(sizeof(tractorbeam_ratelimit_t));
+  if (rl == NULL)
+  { return(NULL); }
+
+  rl->max_rps    = (max_rps > 0) ? max_rps : 0;
+  rl->max_bps    = (max_bps > 0) ? max_bps : 0;
+  rl->requests   = rl->max_rps;
+  rl->bytes      = rl->max_bps;
+  rl->scale      = 1.0;
+  rl->latency    = 0;
+  rl->target     = (target_latency_in_ms > 0) ? target_latency_in_ms * 1000L : 0;
+  rl->backoff_at = 0;
+  rl->refill_at  = __tbr_now();
+  return(rl);
+}
+
+void tractorbeam_ratelimit_acquire(tractorbeam_ratelimit_t *rl)
+{
+  while (1)
+  {
+    long wait = 0;
+    __tbr_refill(rl);
+    if (rl->max_rps > 0 && rl->requests < 1)
+    { wait = (long) ((1 - rl->requests) * 1e6 / (rl->max_rps * rl->scale)); }
+    if (rl->max_bps > 0 && rl->bytes < 0)
+    {
+      long bwait = (long) (-rl->bytes * 1e6 / (rl->max_bps * rl->scale));
+      wait       = (bwait > wait) ? bwait : wait;
+    }
+    if (wait <= 0)
+    { break; }
+    __tbr_sleep(wait);
+  }
+
+  if (rl->max_rps > 0)
+  { rl->requests -= 1; }
+}
+
+void tractorbeam_ratelimit_release(tractorbeam_ratelimit_t *rl, size_t bytes, long latency_in_us)
+{
+  if (rl->max_bps > 0)
+  { rl->bytes -= (double) bytes; }
+
+  if (rl->target == 0)
+  { return; }
+
+  /* halves the rates at most once per target period, so the effect
+   * of the previous adjustment can be observed */
+  long now    = __tbr_now();
+  rl->latency = (1 - TBR_SMOOTHING) * rl->latency + TBR_SMOOTHING * latency_in_us;
+  if (rl->latency > rl->target)
+  {
+    if (now >= rl->backoff_at && rl->scale > TBR_MIN_SCALE)
+    {
+      rl->scale      = (rl->scale / 2 < TBR_MIN_SCALE) ? TBR_MIN_SCALE : rl->scale / 2;
+      rl->backoff_at = now + rl->target;
+      TB_DEBUG("latency above target (%ldus); rate scale: %f", (long) rl->latency, rl->scale);
+    }
+  }
+  else if (rl->scale < 1.0)
+  { rl->scale = (rl->scale + TBR_RECOVERY > 1.0) ? 1.0 : rl->scale + TBR_RECOVERY; }
+}
+
+void tractorbeam_ratelimit_term(tractorbeam_ratelimit_t *rl)
+{ free(rl); }
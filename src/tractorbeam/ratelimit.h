@@ -0,0 +1,73 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_ratelimit_h__
+#define __tractorbeam_ratelimit_h__
+
+#include <stdlib.h>
+
+typedef struct tractorbeam_ratelimit_t tractorbeam_ratelimit_t;
+
+/*! Creates a token bucket limiter.
+ *
+ * Requests and bytes use independent buckets, each allowing a burst
+ * of one second worth of tokens. When a latency target is given the
+ * effective rates are halved whenever the (smoothed) latency goes
+ * above it and slowly restored while it stays below.
+ *
+ * \param max_rps Maximum number of requests per second (0 means no
+ *                limit);
+ *
+ * \param max_bps Maximum number of bytes per second (0 means no
+ *                limit);
+ *
+ * \param target_latency_in_ms The latency above which the limiter
+ *                             backs off (0 disables);
+ *
+ * \return The limiter or NULL if there was any error;
+ */
+tractorbeam_ratelimit_t *tractorbeam_ratelimit_init(int max_rps, long max_bps, int target_latency_in_ms);
+
+/*! Blocks until another request is allowed and accounts for it.
+ */
+void tractorbeam_ratelimit_acquire(tractorbeam_ratelimit_t *);
+
+/*! Reports the outcome of a request.
+ *
+ * \param bytes The number of bytes transferred. This may take the
+ *              byte bucket below zero, which delays the requests that
+ *              follow;
+ *
+ * \param latency_in_us How long the request took;
+ */
+void tractorbeam_ratelimit_release(tractorbeam_ratelimit_t *, size_t bytes, long latency_in_us);
+
+/*! Free all resources used by this limiter.
+ */
+void tractorbeam_ratelimit_term(tractorbeam_ratelimit_t *);
+
+#endif
@@ -0,0 +1,671 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "tractorbeam/tree.h"
+#include "tractorbeam/debug.h"
+#include "tractorbeam/probe.h"
+#include "tractorbeam/serve.h"
+#include "tractorbeam/helpers.h"
+#include "tractorbeam/monitor.h"
+
+#define TBSRV_HEADER 6
+#define TBSRV_PATH_MAX 65536
+#define TBSRV_INPUT_MAX (TBSRV_PATH_MAX + 5 + TBSRV_READ_SIZE)
+#define TBSRV_OUTPUT_MAX 67108864
+#define TBSRV_READ_SIZE 4096
+#define TBSRV_BUFFER_MIN 4096
+#define TBSRV_BACKLOG 128
+
+typedef struct
+{
+  int fd;
+  char *in;
+  size_t insize;
+  size_t incap;
+  char *out;
+  size_t outoff;
+  size_t outsize;
+  size_t outcap;
+  char **subs;
+  size_t nsubs;
+  size_t subscap;
+} tbsrv_client_t;
+
+typedef struct
+{
+  tractorbeam_serve_t *rt;
+  tractorbeam_monitor_t *mh;
+  pthread_t refresher;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int dirty;
+  int closing;
+  tractorbeam_tree_t *pending;
+  tractorbeam_tree_t *tree;
+  int wakeup[2];
+  int listener;
+  tbsrv_client_t *clients;
+  size_t nclients;
+  size_t clientcap;
+  struct pollfd *pfds;
+  size_t pfdcap;
+} tbsrv_t;
+
+/* Runs on the zookeeper completion thread. */
+static
+void __tbsrv_changed(void *ctx)
+{
+  tbsrv_t *srv = (tbsrv_t *) ctx;
+  if (pthread_mutex_lock(&srv->mutex) == 0)
+  {
+    srv->dirty = 1;
+    pthread_cond_signal(&srv->cond);
+    pthread_mutex_unlock(&srv->mutex);
+  }
+}
+
+static
+int __tbsrv_collect(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  UNUSED(stat);
+  if (event == DONE)
+  { return(0); }
+  else if (event != ITEM)
+  { return(-1); }
+  return(tractorbeam_tree_add((tractorbeam_tree_t *) data, ppath, name, contents, contsize));
+}
+
+static
+tractorbeam_tree_t *__tbsrv_load(tbsrv_t *srv)
+{
+  tractorbeam_tree_t *tree = tractorbeam_tree_init();
+  if (tree == NULL)
+  { return(NULL); }
+
+  if (tractorbeam_monitor_snapshot(srv->mh, srv->rt->path, __tbsrv_collect, tree) != 0)
+  {
+    tractorbeam_tree_term(tree);
+    return(NULL);
+  }
+  tractorbeam_tree_seal(tree);
+  return(tree);
+}
+
+/* Takes a new snapshot whenever a watch fires, at most once every
+ * min_interval (changes in between get coalesced). The new tree is
+ * handed to the main thread, which owns the current one, so lookups
+ * never wait for a snapshot.
+ *
+ * This also moves the session every rebalance seconds, if needed. The
+ * monitor reports the new session as a change, so the tree gets
+ * reloaded (and the watches set again) once it is established.
+ */
+static
+void *__tbsrv_refresher(void *ctx)
+{
+  tbsrv_t *srv  = (tbsrv_t *) ctx;
+  time_t probed = time(NULL);
+  struct timespec ts;
+
+  if (pthread_mutex_lock(&srv->mutex) != 0)
+  { return(NULL); }
+
+  while (! srv->closing)
+  {
+    if (srv->rt->rebalance > 0 && time(NULL) - probed >= srv->rt->rebalance)
+    {
+      pthread_mutex_unlock(&srv->mutex);
+      if (tractorbeam_monitor_rebalance(srv->mh) == -1)
+      { TB_DEBUG0("error probing servers"); }
+      probed = time(NULL);
+      if (pthread_mutex_lock(&srv->mutex) != 0)
+      { return(NULL); }
+      continue;
+    }
+
+    if (! srv->dirty)
+    {
+      if (srv->rt->rebalance > 0)
+      {
+        ts.tv_sec  = probed + srv->rt->rebalance;
+        ts.tv_nsec = 0;
+        pthread_cond_timedwait(&srv->cond, &srv->mutex, &ts);
+      }
+      else
+      { pthread_cond_wait(&srv->cond, &srv->mutex); }
+      continue;
+    }
+    srv->dirty = 0;
+    pthread_mutex_unlock(&srv->mutex);
+
+    tractorbeam_tree_t *tree = __tbsrv_load(srv);
+    if (pthread_mutex_lock(&srv->mutex) != 0)
+    {
+      tractorbeam_tree_term(tree);
+      return(NULL);
+    }
+    if (tree == NULL)
+    {
+      TB_DEBUG("error loading tree: %s", srv->rt->path);
+      srv->dirty = 1;
+    }
+    else
+    {
+      TB_DEBUG("tree loaded: %s (%lu nodes)", srv->rt->path, (unsigned long) tractorbeam_tree_count(tree));
+      tractorbeam_tree_term(srv->pending);
+      srv->pending = tree;
+      if (write(srv->wakeup[1], "", 1) == -1 && errno != EAGAIN)
+      { TB_DEBUG0("error waking up main thread"); }
+    }
+    pthread_mutex_unlock(&srv->mutex);
+
+    ts.tv_sec  = srv->rt->min_interval / 1000;
+    ts.tv_nsec = (long) (srv->rt->min_interval % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+
+    if (pthread_mutex_lock(&srv->mutex) != 0)
+    { return(NULL); }
+  }
+
+  pthread_mutex_unlock(&srv->mutex);
+  return(NULL);
+}
+
+static
+int __tbsrv_nonblock(int fd)
+{
+  int flags = fcntl(fd, F_GETFL);
+  if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+  { return(-1); }
+  return(0);
+}
+
+static
+int __tbsrv_listen(const char *path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+
+  if (strlen(path) >= sizeof(addr.sun_path))
+  {
+    TB_DEBUG("socket path too long: %s", path);
+    return(-1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  // a socket left by a previous run
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+  { unlink(path); }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+  { return(-1); }
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+      || listen(fd, TBSRV_BACKLOG) != 0
+      || __tbsrv_nonblock(fd) != 0)
+  {
+    TB_DEBUG("error listening on: %s", path);
+    close(fd);
+    return(-1);
+  }
+  return(fd);
+}
+
+static
+int __tbsrv_reserve(tbsrv_client_t *c, size_t size)
+{
+  if (c->outoff > 0 && c->outoff == c->outsize)
+  {
+    c->outoff  = 0;
+    c->outsize = 0;
+  }
+  return(tbh_grow(&c->out, &c->outcap, c->outsize + size, TBSRV_BUFFER_MIN, TBSRV_OUTPUT_MAX));
+}
+
+static
+void __tbsrv_header(tbsrv_client_t *c, char op, char status, size_t length)
+{
+  uint32_t len = htonl((uint32_t) length);
+  c->out[c->outsize]     = op;
+  c->out[c->outsize + 1] = status;
+  memcpy(c->out + c->outsize + 2, &len, 4);
+  c->outsize += TBSRV_HEADER;
+}
+
+static
+int __tbsrv_reply(tbsrv_client_t *c, char op, char status, const void *payload, size_t length)
+{
+  if (length > UINT32_MAX || __tbsrv_reserve(c, TBSRV_HEADER + length) != 0)
+  { return(-1); }
+  __tbsrv_header(c, op, status, length);
+  if (length > 0)
+  { memcpy(c->out + c->outsize, payload, length); }
+  c->outsize += length;
+  return(0);
+}
+
+static
+int __tbsrv_list(tbsrv_t *srv, tbsrv_client_t *c, const char *path)
+{
+  size_t first, k, length = 0;
+  size_t count = tractorbeam_tree_list(srv->tree, path, &first);
+  size_t dummy;
+
+  if (count == 0 && tractorbeam_tree_get(srv->tree, path, &dummy) == NULL)
+  { return(__tbsrv_reply(c, 'l', TBSRV_NOTFOUND, NULL, 0)); }
+
+  for (k=0; k<count; k+=1)
+  { length += strlen(tractorbeam_tree_name(srv->tree, first + k)) + 1; }
+  if (length > UINT32_MAX || __tbsrv_reserve(c, TBSRV_HEADER + length) != 0)
+  { return(-1); }
+
+  __tbsrv_header(c, 'l', TBSRV_OK, length);
+  for (k=0; k<count; k+=1)
+  {
+    const char *name = tractorbeam_tree_name(srv->tree, first + k);
+    size_t namelen   = strlen(name) + 1;
+    memcpy(c->out + c->outsize, name, namelen);
+    c->outsize += namelen;
+  }
+  return(0);
+}
+
+static
+int __tbsrv_subscribe(tbsrv_client_t *c, const char *path)
+{
+  if (c->nsubs == c->subscap)
+  {
+    size_t cap  = (c->subscap == 0) ? 4 : c->subscap * 2;
+    char **tmp  = (char **) realloc(c->subs, sizeof(char *) * cap);
+    if (tmp == NULL)
+    { return(-1); }
+    c->subs    = tmp;
+    c->subscap = cap;
+  }
+  if ((c->subs[c->nsubs] = tbh_strdup(path)) == NULL)
+  { return(-1); }
+  c->nsubs += 1;
+  return(__tbsrv_reply(c, 's', TBSRV_OK, NULL, 0));
+}
+
+static
+int __tbsrv_unsubscribe(tbsrv_client_t *c, const char *path)
+{
+  size_t k;
+  for (k=0; k<c->nsubs; k+=1)
+  {
+    if (strcmp(c->subs[k], path) == 0)
+    {
+      free(c->subs[k]);
+      c->subs[k] = c->subs[--c->nsubs];
+      break;
+    }
+  }
+  return(__tbsrv_reply(c, 'u', TBSRV_OK, NULL, 0));
+}
+
+static
+int __tbsrv_request(tbsrv_t *srv, tbsrv_client_t *c, char op, const char *path)
+{
+  const char *data;
+  size_t datasize;
+
+  if (path[0] != '/')
+  { return(__tbsrv_reply(c, op, TBSRV_BADREQUEST, NULL, 0)); }
+
+  switch (op)
+  {
+  case 'g':
+    data = tractorbeam_tree_get(srv->tree, path, &datasize);
+    if (data == NULL)
+    { return(__tbsrv_reply(c, op, TBSRV_NOTFOUND, NULL, 0)); }
+    return(__tbsrv_reply(c, op, TBSRV_OK, data, datasize));
+  case 'l':
+    return(__tbsrv_list(srv, c, path));
+  case 's':
+    return(__tbsrv_subscribe(c, path));
+  case 'u':
+    return(__tbsrv_unsubscribe(c, path));
+  default:
+    return(__tbsrv_reply(c, op, TBSRV_BADREQUEST, NULL, 0));
+  }
+}
+
+/* Reads whatever is available and handles every complete request. */
+static
+int __tbsrv_read(tbsrv_t *srv, tbsrv_client_t *c)
+{
+  size_t offset = 0;
+  uint32_t len;
+
+  while (1)
+  {
+    if (tbh_grow(&c->in, &c->incap, c->insize + TBSRV_READ_SIZE, TBSRV_BUFFER_MIN, TBSRV_INPUT_MAX) != 0)
+    { return(-1); }
+    ssize_t r = read(c->fd, c->in + c->insize, c->incap - c->insize);
+    if (r == 0)
+    { return(-1); }
+    else if (r == -1 && errno == EINTR)
+    { continue; }
+    else if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    { break; }
+    else if (r == -1)
+    { return(-1); }
+    c->insize += (size_t) r;
+    if (c->incap - c->insize > 0)
+    { break; }
+  }
+
+  while (c->insize - offset >= 5)
+  {
+    memcpy(&len, c->in + offset + 1, 4);
+    len = ntohl(len);
+    if (len > TBSRV_PATH_MAX)
+    { return(-1); }
+    if (c->insize - offset < 5 + (size_t) len)
+    { break; }
+
+    // paths get '\0' terminated in place (saving the next byte)
+    char *path = c->in + offset + 5;
+    char saved = (c->insize > offset + 5 + len) ? path[len] : '\0';
+    if (c->incap == c->insize && tbh_grow(&c->in, &c->incap, c->insize + 1, TBSRV_BUFFER_MIN, TBSRV_INPUT_MAX) != 0)
+    { return(-1); }
+    path      = c->in + offset + 5;
+    path[len] = '\0';
+    int rc    = __tbsrv_request(srv, c, c->in[offset], path);
+    path[len] = saved;
+    if (rc != 0)
+    { return(-1); }
+    offset += 5 + (size_t) len;
+  }
+
+  memmove(c->in, c->in + offset, c->insize - offset);
+  c->insize -= offset;
+  return(0);
+}
+
+static
+int __tbsrv_flush(tbsrv_client_t *c)
+{
+  while (c->outoff < c->outsize)
+  {
+    ssize_t w = send(c->fd, c->out + c->outoff, c->outsize - c->outoff, MSG_NOSIGNAL);
+    if (w == -1 && errno == EINTR)
+    { continue; }
+    else if (w == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    { break; }
+    else if (w == -1)
+    { return(-1); }
+    c->outoff += (size_t) w;
+  }
+  return(0);
+}
+
+static
+void __tbsrv_drop(tbsrv_t *srv, size_t k)
+{
+  tbsrv_client_t *c = &srv->clients[k];
+  size_t j;
+  close(c->fd);
+  free(c->in);
+  free(c->out);
+  for (j=0; j<c->nsubs; j+=1)
+  { free(c->subs[j]); }
+  free(c->subs);
+  srv->clients[k] = srv->clients[--srv->nclients];
+}
+
+static
+void __tbsrv_accept(tbsrv_t *srv)
+{
+  while (1)
+  {
+    int fd = accept(srv->listener, NULL, NULL);
+    if (fd == -1)
+    { return; }
+    if (__tbsrv_nonblock(fd) != 0)
+    {
+      close(fd);
+      continue;
+    }
+
+    if (srv->nclients == srv->clientcap)
+    {
+      size_t cap          = (srv->clientcap == 0) ? 16 : srv->clientcap * 2;
+      tbsrv_client_t *tmp = (tbsrv_client_t *) realloc(srv->clients, sizeof(tbsrv_client_t) * cap);
+      if (tmp == NULL)
+      {
+        close(fd);
+        return;
+      }
+      srv->clients   = tmp;
+      srv->clientcap = cap;
+    }
+
+    tbsrv_client_t *c = &srv->clients[srv->nclients++];
+    memset(c, 0, sizeof(tbsrv_client_t));
+    c->fd = fd;
+  }
+}
+
+/* Installs the tree loaded by the refresher and notifies the
+ * subscribers of the nodes that have changed. */
+static
+void __tbsrv_swap(tbsrv_t *srv)
+{
+  char drain[64];
+  while (read(srv->wakeup[0], drain, sizeof(drain)) > 0)
+  { }
+
+  if (pthread_mutex_lock(&srv->mutex) != 0)
+  { return; }
+  tractorbeam_tree_t *tree = srv->pending;
+  srv->pending             = NULL;
+  pthread_mutex_unlock(&srv->mutex);
+  if (tree == NULL)
+  { return; }
+
+  for (size_t k=srv->nclients; k>0; k-=1)
+  {
+    tbsrv_client_t *c = &srv->clients[k-1];
+    int rc            = 0;
+    for (size_t j=0; rc == 0 && j<c->nsubs; j+=1)
+    {
+      size_t datasize;
+      if (tractorbeam_tree_same(srv->tree, tree, c->subs[j]))
+      { continue; }
+      char status = (tractorbeam_tree_get(tree, c->subs[j], &datasize) == NULL) ? TBSRV_NOTFOUND : TBSRV_OK;
+      rc = __tbsrv_reply(c, 'n', status, c->subs[j], strlen(c->subs[j]));
+    }
+    if (rc != 0)
+    {
+      TB_DEBUG0("dropping slow client");
+      __tbsrv_drop(srv, k-1);
+    }
+  }
+
+  tractorbeam_tree_term(srv->tree);
+  srv->tree = tree;
+}
+
+static
+int __tbsrv_loop(tbsrv_t *srv)
+{
+  while (1)
+  {
+    size_t k, npfds = 2 + srv->nclients;
+    if (npfds > srv->pfdcap)
+    {
+      struct pollfd *tmp = (struct pollfd *) realloc(srv->pfds, sizeof(struct pollfd) * npfds * 2);
+      if (tmp == NULL)
+      { return(-1); }
+      srv->pfds   = tmp;
+      srv->pfdcap = npfds * 2;
+    }
+
+    // clients are only accepted once the first tree gets loaded
+    srv->pfds[0].fd     = srv->wakeup[0];
+    srv->pfds[0].events = POLLIN;
+    srv->pfds[1].fd     = srv->listener;
+    srv->pfds[1].events = (srv->tree == NULL) ? 0 : POLLIN;
+    for (k=0; k<srv->nclients; k+=1)
+    {
+      tbsrv_client_t *c       = &srv->clients[k];
+      srv->pfds[2 + k].fd     = c->fd;
+      srv->pfds[2 + k].events = POLLIN | ((c->outoff < c->outsize) ? POLLOUT : 0);
+    }
+
+    if (poll(srv->pfds, npfds, -1) == -1)
+    {
+      if (errno == EINTR)
+      { continue; }
+      return(-1);
+    }
+
+    // clients are visited backwards as dropping one moves the last
+    // into its place
+    for (k=npfds-2; k>0; k-=1)
+    {
+      short revents = srv->pfds[1 + k].revents;
+      if (revents == 0)
+      { continue; }
+      if ((revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL)) && __tbsrv_read(srv, &srv->clients[k-1]) != 0)
+      {
+        __tbsrv_drop(srv, k-1);
+        continue;
+      }
+      if (__tbsrv_flush(&srv->clients[k-1]) != 0)
+      { __tbsrv_drop(srv, k-1); }
+    }
+
+    if (srv->pfds[0].revents & POLLIN)
+    {
+      __tbsrv_swap(srv);
+      for (k=srv->nclients; k>0; k-=1)
+      {
+        if (__tbsrv_flush(&srv->clients[k-1]) != 0)
+        { __tbsrv_drop(srv, k-1); }
+      }
+    }
+    if (srv->pfds[1].revents & POLLIN)
+    { __tbsrv_accept(srv); }
+  }
+}
+
+int tractorbeam_serve(tractorbeam_serve_t *rt)
+{
+  tbsrv_t srv;
+  char *endpoint = NULL;
+  int rc         = -1;
+
+  memset(&srv, 0, sizeof(srv));
+  srv.rt         = rt;
+  srv.dirty      = 1;
+  srv.listener   = -1;
+  srv.wakeup[0]  = -1;
+  srv.wakeup[1]  = -1;
+
+  if (pthread_mutex_init(&srv.mutex, NULL) != 0)
+  { return(-1); }
+  if (pthread_cond_init(&srv.cond, NULL) != 0)
+  {
+    pthread_mutex_destroy(&srv.mutex);
+    return(-1);
+  }
+
+  if (pipe(srv.wakeup) != 0
+      || __tbsrv_nonblock(srv.wakeup[0]) != 0
+      || __tbsrv_nonblock(srv.wakeup[1]) != 0
+      || (srv.listener = __tbsrv_listen(rt->socket)) == -1)
+  { goto handle_error; }
+
+  if (rt->rebalance >= 0)
+  { endpoint = tractorbeam_probe_sort(rt->endpoint, TBP_TIMEOUT); }
+  srv.mh = tractorbeam_monitor_init((endpoint == NULL) ? rt->endpoint : endpoint, rt->path, rt->timeout);
+  free(endpoint);
+  if (srv.mh == NULL)
+  {
+    TB_DEBUG0("error connecting to zookeeper");
+    goto handle_error;
+  }
+  tractorbeam_monitor_buffer(srv.mh, (size_t) rt->max_data);
+  tractorbeam_monitor_watch(srv.mh, __tbsrv_changed, &srv);
+
+  if (pthread_create(&srv.refresher, NULL, __tbsrv_refresher, &srv) != 0)
+  { goto handle_error; }
+
+  rc = __tbsrv_loop(&srv);
+  TB_DEBUG0("error serving requests");
+
+  if (pthread_mutex_lock(&srv.mutex) == 0)
+  {
+    srv.closing = 1;
+    pthread_cond_signal(&srv.cond);
+    pthread_mutex_unlock(&srv.mutex);
+  }
+  pthread_join(srv.refresher, NULL);
+
+handle_error:
+  if (srv.mh != NULL)
+  { tractorbeam_monitor_term(srv.mh); }
+  while (srv.nclients > 0)
+  { __tbsrv_drop(&srv, srv.nclients - 1); }
+  free(srv.clients);
+  free(srv.pfds);
+  tractorbeam_tree_term(srv.tree);
+  tractorbeam_tree_term(srv.pending);
+  if (srv.listener != -1)
+  {
+    close(srv.listener);
+    unlink(rt->socket);
+  }
+  if (srv.wakeup[0] != -1)
+  { close(srv.wakeup[0]); }
+  if (srv.wakeup[1] != -1)
+  { close(srv.wakeup[1]); }
+  pthread_cond_destroy(&srv.cond);
+  pthread_mutex_destroy(&srv.mutex);
+  return(rc);
+}
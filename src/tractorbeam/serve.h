@@ -0,0 +1,69 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_serve_h__
+#define __tractorbeam_serve_h__
+
+/* Protocol (all integers are 32 bits, in network byte order)
+ *
+ * Requests: <OP:1 byte> <LENGTH> <PATH:LENGTH bytes>
+ *
+ *   'g' get: replies the contents of the node;
+ *   'l' list: replies the names of the children, each one followed
+ *       by a '\0';
+ *   's' subscribe: replies right away (with no payload) and then
+ *       sends a notification whenever the contents or the children
+ *       of the node change;
+ *   'u' unsubscribe;
+ *
+ * Replies: <OP:1 byte> <STATUS:1 byte> <LENGTH> <PAYLOAD:LENGTH bytes>
+ *
+ *   Replies come in the same order as the requests. OP is the one of
+ *   the request or 'n' for notifications, whose payload is the path
+ *   of the node (STATUS is 1 if the node has been removed).
+ */
+#define TBSRV_OK 0
+#define TBSRV_NOTFOUND 1
+#define TBSRV_BADREQUEST 2
+
+typedef struct
+{
+  char *endpoint;
+  char *path;
+  char *socket;
+  int timeout;
+  int rebalance;
+  int min_interval;
+  long max_data;
+} tractorbeam_serve_t;
+
+/*! Keeps a tree in memory and serves it over a unix socket (this
+ *  function only returns on errors).
+ */
+int tractorbeam_serve(tractorbeam_serve_t *);
+
+#endif
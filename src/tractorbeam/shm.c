@@ -0,0 +1,226 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "tractorbeam/shm.h"
+#include "tractorbeam/debug.h"
+#include "tractorbeam/shmread.h"
+
+struct tractorbeam_shmpub_t
+{
+  int fd;
+  char *base;
+  size_t size;
+  tractorbeam_shm_header_t *header;
+  uint64_t generation;
+  char *half;
+  uint64_t halfsize;
+  uint64_t strings;
+  tractorbeam_shm_node_t *nodes;
+  size_t count;
+  size_t capacity;
+};
+
+static
+uint64_t __tbshm_nbuckets(size_t count)
+{
+  uint64_t nbuckets = 2;
+  while (nbuckets < 2 * (uint64_t) count)
+  { nbuckets *= 2; }
+  return(nbuckets);
+}
+
+static
+uint64_t __tbshm_indexsize(size_t count)
+{ return(sizeof(tractorbeam_shm_index_t) + 4 * __tbshm_nbuckets(count) + sizeof(tractorbeam_shm_node_t) * (uint64_t) count); }
+
+static
+int __tbshm_map(tractorbeam_shmpub_t *p, const char *name, size_t halfsize)
+{
+  struct stat st;
+  struct flock lock;
+
+  memset(&lock, 0, sizeof(lock));
+  lock.l_type   = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  if (fcntl(p->fd, F_SETLKW, &lock) != 0 || fstat(p->fd, &st) != 0)
+  { return(-1); }
+
+  int fresh = (st.st_size == 0);
+  if (fresh)
+  {
+    st.st_size = (off_t) (TRACTORBEAM_SHM_HEADER + 2 * halfsize);
+    if (ftruncate(p->fd, st.st_size) != 0)
+    { return(-1); }
+  }
+  else if ((size_t) st.st_size < TRACTORBEAM_SHM_HEADER)
+  { return(-1); }
+
+  p->size = (size_t) st.st_size;
+  p->base = (char *) mmap(NULL, p->size, PROT_READ | PROT_WRITE, MAP_SHARED, p->fd, 0);
+  if (p->base == MAP_FAILED)
+  {
+    p->base = NULL;
+    return(-1);
+  }
+  p->header = (tractorbeam_shm_header_t *) p->base;
+
+  if (fresh)
+  {
+    p->header->magic    = TRACTORBEAM_SHM_MAGIC;
+    p->header->version  = TRACTORBEAM_SHM_VERSION;
+    p->header->halfsize = halfsize;
+  }
+  else if (p->header->magic != TRACTORBEAM_SHM_MAGIC
+           || p->header->version != TRACTORBEAM_SHM_VERSION
+           || p->header->halfsize > (p->size - TRACTORBEAM_SHM_HEADER) / 2)
+  {
+    TB_DEBUG("not a tractorbeam segment: %s", name);
+    return(-1);
+  }
+  else if (p->header->halfsize != halfsize)
+  { TB_DEBUG("keeping the size of the existing segment: %s", name); }
+
+  return(0);
+}
+
+tractorbeam_shmpub_t *tractorbeam_shmpub_init(const char *name, size_t halfsize)
+{
+  halfsize -= halfsize % TRACTORBEAM_SHM_HEADER;
+  if (halfsize < __tbshm_indexsize(0) || halfsize > UINT32_MAX)
+  {
+    TB_DEBUG("invalid segment size: %lu", (unsigned long) halfsize);
+    return(NULL);
+  }
+
+  tractorbeam_shmpub_t *p = (tractorbeam_shmpub_t *) malloc(sizeof(tractorbeam_shmpub_t));
+  if (p == NULL)
+  { return(NULL); }
+  memset(p, 0, sizeof(tractorbeam_shmpub_t));
+
+  p->fd = shm_open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (p->fd == -1 || __tbshm_map(p, name, halfsize) != 0)
+  {
+    TB_DEBUG("could not open segment: %s", name);
+    tractorbeam_shmpub_term(p);
+    return(NULL);
+  }
+
+  // claims the snapshot not in use, so that readers still on it (from
+  // the generation before) know it is about to change
+  p->generation = __atomic_load_n(&p->header->generation, __ATOMIC_ACQUIRE) + 1;
+  p->halfsize   = p->header->halfsize;
+  p->half       = p->base + TRACTORBEAM_SHM_HEADER + (p->generation & 1) * p->halfsize;
+  p->strings    = p->halfsize;
+  __atomic_store_n(&p->header->start, p->generation, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  return(p);
+}
+
+/* Paths and contents are written straight into the segment, from the
+ * end backwards, as the size of the index is only known at the end. */
+int tractorbeam_shmpub_add(tractorbeam_shmpub_t *p, const char *ppath, const char *name, const void *contents, size_t contsize)
+{
+  size_t plen = strlen(ppath);
+  size_t nlen = strlen(name);
+  uint64_t need = __tbshm_indexsize(p->count + 1) + plen + 1 + nlen + contsize;
+  if (need > p->strings)
+  {
+    TB_DEBUG0("segment too small");
+    return(-1);
+  }
+
+  if (p->count == p->capacity)
+  {
+    size_t capacity = (p->capacity == 0) ? 1024 : p->capacity * 2;
+    tractorbeam_shm_node_t *tmp = (tractorbeam_shm_node_t *) realloc(p->nodes, sizeof(tractorbeam_shm_node_t) * capacity);
+    if (tmp == NULL)
+    { return(-1); }
+    p->nodes    = tmp;
+    p->capacity = capacity;
+  }
+
+  tractorbeam_shm_node_t *node = &p->nodes[p->count];
+  p->strings   -= contsize;
+  node->data    = (uint32_t) p->strings;
+  node->datalen = (uint32_t) contsize;
+  if (contsize > 0)
+  { memcpy(p->half + p->strings, contents, contsize); }
+
+  p->strings   -= plen + 1 + nlen;
+  node->path    = (uint32_t) p->strings;
+  node->pathlen = (uint32_t) (plen + 1 + nlen);
+  memcpy(p->half + p->strings, ppath, plen);
+  p->half[p->strings + plen] = '/';
+  memcpy(p->half + p->strings + plen + 1, name, nlen);
+  node->hash    = tractorbeam_shm_hash(p->half + node->path, node->pathlen);
+
+  p->count += 1;
+  return(0);
+}
+
+int tractorbeam_shmpub_commit(tractorbeam_shmpub_t *p)
+{
+  tractorbeam_shm_index_t index;
+  size_t k;
+
+  index.count    = (uint32_t) p->count;
+  index.nbuckets = (uint32_t) __tbshm_nbuckets(p->count);
+  uint32_t *buckets = (uint32_t *) (p->half + sizeof(index));
+  memcpy(p->half, &index, sizeof(index));
+  memset(buckets, 0, 4 * (size_t) index.nbuckets);
+  for (k=0; k<p->count; k+=1)
+  {
+    uint64_t slot = p->nodes[k].hash & (index.nbuckets - 1);
+    while (buckets[slot] != 0)
+    { slot = (slot + 1) & (index.nbuckets - 1); }
+    buckets[slot] = (uint32_t) (k + 1);
+  }
+  if (p->count > 0)
+  { memcpy(buckets + index.nbuckets, p->nodes, sizeof(tractorbeam_shm_node_t) * p->count); }
+
+  __atomic_store_n(&p->header->generation, p->generation, __ATOMIC_RELEASE);
+  TB_DEBUG("published generation %lu (%lu nodes)", (unsigned long) p->generation, (unsigned long) p->count);
+  return(0);
+}
+
+void tractorbeam_shmpub_term(tractorbeam_shmpub_t *p)
+{
+  if (p->base != NULL)
+  { munmap(p->base, p->size); }
+  if (p->fd != -1)
+  { close(p->fd); }
+  free(p->nodes);
+  free(p);
+}
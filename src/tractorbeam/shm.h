@@ -0,0 +1,64 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_shm_h__
+#define __tractorbeam_shm_h__
+
+#include <stdlib.h>
+
+typedef struct tractorbeam_shmpub_t tractorbeam_shmpub_t;
+
+/*! Opens (or creates) a segment to publish a new snapshot into (the
+ * layout is described in shmread.h).
+ *
+ * Only one writer per segment is allowed at a time, so this blocks
+ * while another recv holds it.
+ *
+ * \param name The name of the segment (e.g. "/tractorbeam.services");
+ *
+ * \param halfsize The room for each snapshot (the segment takes
+ *                 twice as much). Ignored if the segment exists
+ *                 already;
+ */
+tractorbeam_shmpub_t *tractorbeam_shmpub_init(const char *name, size_t halfsize);
+
+/*! Adds a node (arguments as given to tb_snapshot_fn).
+ *
+ * \return 0 on success or -1 if there is no room left;
+ */
+int tractorbeam_shmpub_add(tractorbeam_shmpub_t *, const char *ppath, const char *name, const void *contents, size_t contsize);
+
+/*! Writes the index and makes the snapshot visible to the readers.
+ */
+int tractorbeam_shmpub_commit(tractorbeam_shmpub_t *);
+
+/*! Unmaps the segment. Nodes added but not commited are discarded (the
+ *  previous snapshot stays in place).
+ */
+void tractorbeam_shmpub_term(tractorbeam_shmpub_t *);
+
+#endif
@@ -0,0 +1,234 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_shmread_h__
+#define __tractorbeam_shmread_h__
+
+/* Header-only reader of the snapshots published by `tractorbeam recv
+ * --layout shm`. Opening maps the segment; lookups after that do no
+ * syscalls and take no locks.
+ *
+ * The segment holds a header and room for two snapshots. The writer
+ * fills the one not in use and then bumps the generation, so that
+ * readers move to it on their next lookup. Readers that were still
+ * on the older snapshot when it starts getting overwritten (which
+ * only happens on the next write) notice it through the start
+ * counter and retry.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACTORBEAM_SHM_MAGIC 0x4d534254u
+#define TRACTORBEAM_SHM_VERSION 1
+#define TRACTORBEAM_SHM_HEADER 64
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t halfsize;   /* the room for each snapshot */
+  uint64_t start;      /* the generation being written */
+  uint64_t generation; /* the last generation written */
+} tractorbeam_shm_header_t;
+
+/* Each snapshot starts with an index, followed by the hash buckets
+ * (the node number plus one, 0 being empty), the nodes and the paths
+ * and contents, all offsets relative to the start of the snapshot. */
+typedef struct
+{
+  uint32_t count;
+  uint32_t nbuckets;
+} tractorbeam_shm_index_t;
+
+typedef struct
+{
+  uint64_t hash;
+  uint32_t path;
+  uint32_t pathlen;
+  uint32_t data;
+  uint32_t datalen;
+} tractorbeam_shm_node_t;
+
+typedef struct
+{
+  const char *base;
+  size_t size;
+} tractorbeam_shm_t;
+
+static inline
+uint64_t tractorbeam_shm_hash(const char *path, size_t len)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  size_t k;
+  for (k=0; k<len; k+=1)
+  {
+    hash ^= (unsigned char) path[k];
+    hash *= 1099511628211ULL;
+  }
+  return(hash);
+}
+
+/*! Maps a segment.
+ *
+ * \param name The name given to recv by the --output switch (e.g.
+ *             "/tractorbeam.services");
+ *
+ * \return 0 on success or -1 on errors (the segment does not exist
+ *         or is not a tractorbeam segment);
+ */
+static inline
+int tractorbeam_shm_open(tractorbeam_shm_t *shm, const char *name)
+{
+  struct stat st;
+  const tractorbeam_shm_header_t *header;
+  void *base;
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1)
+  { return(-1); }
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < TRACTORBEAM_SHM_HEADER)
+  {
+    close(fd);
+    return(-1);
+  }
+  base = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  { return(-1); }
+
+  header = (const tractorbeam_shm_header_t *) base;
+  if (header->magic != TRACTORBEAM_SHM_MAGIC
+      || header->version != TRACTORBEAM_SHM_VERSION
+      || header->halfsize > ((uint64_t) st.st_size - TRACTORBEAM_SHM_HEADER) / 2)
+  {
+    munmap(base, (size_t) st.st_size);
+    return(-1);
+  }
+  shm->base = (const char *) base;
+  shm->size = (size_t) st.st_size;
+  return(0);
+}
+
+static inline
+void tractorbeam_shm_close(tractorbeam_shm_t *shm)
+{
+  munmap((void *) shm->base, shm->size);
+  shm->base = NULL;
+  shm->size = 0;
+}
+
+/*! The generation of the latest snapshot (0 means none yet). */
+static inline
+uint64_t tractorbeam_shm_generation(const tractorbeam_shm_t *shm)
+{
+  const tractorbeam_shm_header_t *header = (const tractorbeam_shm_header_t *) shm->base;
+  return(__atomic_load_n(&header->generation, __ATOMIC_ACQUIRE));
+}
+
+/* Everything read may be torn by a concurrent write, so offsets are
+ * checked before being followed (the result gets discarded anyway). */
+static inline
+long __tbshm_lookup(const char *half, uint64_t halfsize, const char *path, size_t len, void *buf, size_t bufsize)
+{
+  tractorbeam_shm_index_t index;
+  tractorbeam_shm_node_t node;
+  uint64_t hash = tractorbeam_shm_hash(path, len);
+  uint32_t k, bucket;
+
+  memcpy(&index, half, sizeof(index));
+  if (index.nbuckets == 0
+      || (index.nbuckets & (index.nbuckets - 1)) != 0
+      || sizeof(index) + 4 * (uint64_t) index.nbuckets + sizeof(node) * (uint64_t) index.count > halfsize)
+  { return(-1); }
+
+  const char *buckets = half + sizeof(index);
+  const char *nodes   = buckets + 4 * (size_t) index.nbuckets;
+  for (k=0; k<index.nbuckets; k+=1)
+  {
+    memcpy(&bucket, buckets + 4 * (size_t) ((hash + k) & (index.nbuckets - 1)), 4);
+    if (bucket == 0 || bucket > index.count)
+    { return(-1); }
+    memcpy(&node, nodes + sizeof(node) * (size_t) (bucket - 1), sizeof(node));
+    if (node.hash != hash
+        || node.pathlen != len
+        || (uint64_t) node.path + node.pathlen > halfsize
+        || memcmp(half + node.path, path, len) != 0)
+    { continue; }
+    if ((uint64_t) node.data + node.datalen > halfsize)
+    { return(-1); }
+    memcpy(buf, half + node.data, (node.datalen < bufsize) ? node.datalen : bufsize);
+    return((long) node.datalen);
+  }
+  return(-1);
+}
+
+/*! Reads the contents of a node.
+ *
+ * \param path The full path of the node (e.g. "/services/web01");
+ *
+ * \param buf Where to copy the contents into;
+ *
+ * \param bufsize The size of buf. Larger contents are truncated;
+ *
+ * \return >=0: the size of the contents (which may be larger than
+ *              bufsize);
+ *
+ * \return -1: the node does not exist;
+ *
+ * \return -2: nothing has been published yet;
+ */
+static inline
+long tractorbeam_shm_get(const tractorbeam_shm_t *shm, const char *path, void *buf, size_t bufsize)
+{
+  const tractorbeam_shm_header_t *header = (const tractorbeam_shm_header_t *) shm->base;
+  size_t len = strlen(path);
+  while (1)
+  {
+    uint64_t generation = __atomic_load_n(&header->generation, __ATOMIC_ACQUIRE);
+    if (generation == 0)
+    { return(-2); }
+    const char *half = shm->base + TRACTORBEAM_SHM_HEADER + (generation & 1) * header->halfsize;
+    long rc          = __tbshm_lookup(half, header->halfsize, path, len, buf, bufsize);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&header->start, __ATOMIC_RELAXED) <= generation + 1)
+    { return(rc); }
+  }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,464 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include "tractorbeam/debug.h"
+#include "tractorbeam/spool.h"
+
+#define TBS_READSIZE 8192
+#define TBS_OVERHEAD (sizeof(uint32_t) + 1)
+
+typedef struct
+{
+  char *mem;
+  size_t size;
+  size_t charged;
+  off_t offset;
+  off_t end;
+  char *buf;
+  size_t bufcap;
+  size_t bufoff;
+  size_t buflen;
+  const char *head;
+  size_t headlen;
+} tbs_run_t;
+
+typedef struct
+{
+  const char *data;
+  uint32_t size;
+} tbs_record_t;
+
+struct tractorbeam_spool_t
+{
+  size_t *budget;
+  size_t batch;
+  int sorted;
+  int error;
+  int fd;
+  off_t fsize;
+  char *cur;
+  size_t cursize;
+  size_t curcap;
+  size_t curcount;
+  size_t charged;
+  int spill;
+  tbs_run_t *runs;
+  size_t nruns;
+  size_t runscap;
+  size_t reading;
+  int primed;
+  tbs_run_t *last;
+};
+
+static
+int __tbs_compare(const void *a, const void *b)
+{
+  const tbs_record_t *x = (const tbs_record_t *) a;
+  const tbs_record_t *y = (const tbs_record_t *) b;
+  int rc = memcmp(x->data, y->data, (x->size < y->size) ? x->size : y->size);
+  if (rc == 0)
+  { rc = (x->size > y->size) - (x->size < y->size); }
+  return(rc);
+}
+
+static
+int __tbs_tmpfile(tractorbeam_spool_t *s)
+{
+  char path[4096];
+  const char *tmpdir = getenv("TMPDIR");
+
+  snprintf(path, sizeof(path), "%s/tractorbeam.XXXXXX", (tmpdir == NULL) ? "/tmp" : tmpdir);
+  s->fd = mkstemp(path);
+  if (s->fd == -1)
+  {
+    TB_DEBUG("could not create temporary file: %s", path);
+    return(-1);
+  }
+  unlink(path);
+  return(0);
+}
+
+static
+int __tbs_write(int fd, const char *data, size_t size, off_t offset)
+{
+  while (size > 0)
+  {
+    ssize_t rc = pwrite(fd, data, size, offset);
+    if (rc <= 0)
+    { return(-1); }
+    data   += rc;
+    size   -= (size_t) rc;
+    offset += rc;
+  }
+  return(0);
+}
+
+/* Rewrites the current batch in ascending order. */
+static
+int __tbs_sort(tractorbeam_spool_t *s)
+{
+  tbs_record_t *records = (tbs_record_t *) malloc(sizeof(tbs_record_t) * s->curcount);
+  char *sorted          = (char *) malloc(s->cursize);
+  size_t offset         = 0;
+  size_t k;
+
+  if (records == NULL || sorted == NULL)
+  {
+    free(records);
+    free(sorted);
+    return(-1);
+  }
+
+  for (k=0; k<s->curcount; k+=1)
+  {
+    memcpy(&records[k].size, s->cur+offset, sizeof(uint32_t));
+    records[k].data = s->cur + offset + sizeof(uint32_t);
+    offset         += records[k].size + TBS_OVERHEAD;
+  }
+  qsort(records, s->curcount, sizeof(tbs_record_t), __tbs_compare);
+
+  offset = 0;
+  for (k=0; k<s->curcount; k+=1)
+  {
+    memcpy(sorted+offset, records[k].data - sizeof(uint32_t), records[k].size + TBS_OVERHEAD);
+    offset += records[k].size + TBS_OVERHEAD;
+  }
+
+  free(records);
+  free(s->cur);
+  s->cur    = sorted;
+  s->curcap = s->cursize;
+  return(0);
+}
+
+/* Turns the current batch into a run, either in memory or on file. */
+static
+int __tbs_flush(tractorbeam_spool_t *s)
+{
+  tbs_run_t *run;
+  if (s->curcount == 0)
+  { return(0); }
+
+  if (s->nruns == s->runscap)
+  {
+    size_t cap     = (s->runscap == 0) ? 4 : s->runscap * 2;
+    tbs_run_t *tmp = (tbs_run_t *) realloc(s->runs, sizeof(tbs_run_t) * cap);
+    if (tmp == NULL)
+    { return(-1); }
+    s->runs    = tmp;
+    s->runscap = cap;
+  }
+
+  if (s->sorted && s->curcount > 1 && __tbs_sort(s) != 0)
+  { return(-1); }
+
+  run          = &s->runs[s->nruns];
+  run->mem     = NULL;
+  run->size    = s->cursize;
+  run->charged = 0;
+  run->offset  = 0;
+  run->end     = (off_t) s->cursize;
+  run->buf     = NULL;
+  run->bufcap  = 0;
+  run->bufoff  = 0;
+  run->buflen  = 0;
+  run->head    = NULL;
+  run->headlen = 0;
+
+  if (s->spill)
+  {
+    if (s->fd == -1 && __tbs_tmpfile(s) != 0)
+    { return(-1); }
+    if (__tbs_write(s->fd, s->cur, s->cursize, s->fsize) != 0)
+    {
+      TB_DEBUG0("error writing temporary file");
+      return(-1);
+    }
+    run->offset  = s->fsize;
+    run->end     = s->fsize + (off_t) s->cursize;
+    s->fsize    += (off_t) s->cursize;
+    *s->budget  += s->charged;
+    s->cursize   = 0;
+  }
+  else
+  {
+    run->mem     = s->cur;
+    run->charged = s->charged;
+    s->cur       = NULL;
+    s->cursize   = 0;
+    s->curcap    = 0;
+  }
+
+  s->nruns   += 1;
+  s->curcount = 0;
+  s->charged  = 0;
+  s->spill    = 0;
+  return(0);
+}
+
+/* Makes sure at least `size' bytes are buffered for a file run. */
+static
+int __tbs_fill(tractorbeam_spool_t *s, tbs_run_t *run, size_t size)
+{
+  if (run->buflen - run->bufoff >= size)
+  { return(0); }
+
+  memmove(run->buf, run->buf + run->bufoff, run->buflen - run->bufoff);
+  run->buflen -= run->bufoff;
+  run->bufoff  = 0;
+  if (run->bufcap < size || run->bufcap < TBS_READSIZE)
+  {
+    size_t cap = (size < TBS_READSIZE) ? TBS_READSIZE : size;
+    char *tmp  = (char *) realloc(run->buf, cap);
+    if (tmp == NULL)
+    { return(-1); }
+    run->buf    = tmp;
+    run->bufcap = cap;
+  }
+
+  while (run->buflen < size && run->offset < run->end)
+  {
+    size_t want = run->bufcap - run->buflen;
+    if ((off_t) want > run->end - run->offset)
+    { want = (size_t) (run->end - run->offset); }
+    ssize_t rc = pread(s->fd, run->buf + run->buflen, want, run->offset);
+    if (rc <= 0)
+    { return(-1); }
+    run->buflen += (size_t) rc;
+    run->offset += rc;
+  }
+
+  return((run->buflen < size) ? -1 : 0);
+}
+
+static
+void __tbs_release(tractorbeam_spool_t *s, tbs_run_t *run)
+{
+  *s->budget  += run->charged;
+  run->charged = 0;
+  free(run->mem);
+  free(run->buf);
+  run->mem    = NULL;
+  run->buf    = NULL;
+  run->bufcap = 0;
+}
+
+static
+const char *__tbs_read(tractorbeam_spool_t *s, tbs_run_t *run, size_t *size)
+{
+  uint32_t len;
+  const char *record;
+
+  if (run->mem != NULL)
+  {
+    if ((size_t) run->offset >= run->size)
+    { goto handle_eof; }
+    memcpy(&len, run->mem + run->offset, sizeof(uint32_t));
+    record       = run->mem + run->offset + sizeof(uint32_t);
+    run->offset += len + TBS_OVERHEAD;
+  }
+  else
+  {
+    if (run->bufoff == run->buflen && run->offset >= run->end)
+    { goto handle_eof; }
+    if (__tbs_fill(s, run, sizeof(uint32_t)) != 0)
+    { goto handle_error; }
+    memcpy(&len, run->buf + run->bufoff, sizeof(uint32_t));
+    if (__tbs_fill(s, run, len + TBS_OVERHEAD) != 0)
+    { goto handle_error; }
+    record       = run->buf + run->bufoff + sizeof(uint32_t);
+    run->bufoff += len + TBS_OVERHEAD;
+  }
+
+  *size = len;
+  return(record);
+
+handle_error:
+  TB_DEBUG0("error reading temporary file");
+  s->error = 1;
+
+handle_eof:
+  __tbs_release(s, run);
+  return(NULL);
+}
+
+tractorbeam_spool_t *tractorbeam_spool_init(size_t *budget, size_t batch, int sorted)
+{
+  tractorbeam_spool_t *s = (tractorbeam_spool_t *) malloc(sizeof(tractorbeam_spool_t));
+  if (s == NULL)
+  { return(NULL); }
+
+  s->budget   = budget;
+  s->batch    = (batch == 0) ? 1 : batch;
+  s->sorted   = sorted;
+  s->error    = 0;
+  s->fd       = -1;
+  s->fsize    = 0;
+  s->cur      = NULL;
+  s->cursize  = 0;
+  s->curcap   = 0;
+  s->curcount = 0;
+  s->charged  = 0;
+  s->spill    = 0;
+  s->runs     = NULL;
+  s->nruns    = 0;
+  s->runscap  = 0;
+  s->reading  = 0;
+  s->primed   = 0;
+  s->last     = NULL;
+  return(s);
+}
+
+int tractorbeam_spool_push(tractorbeam_spool_t *s, const void *record, size_t size)
+{
+  size_t need = size + TBS_OVERHEAD;
+  uint32_t len = (uint32_t) size;
+
+  if (s->error || size > UINT32_MAX)
+  { return(-1); }
+
+  if (s->cursize + need > s->curcap)
+  {
+    size_t cap = (s->curcap == 0) ? TBS_READSIZE : s->curcap;
+    while (cap < s->cursize + need)
+    { cap *= 2; }
+    char *tmp = (char *) realloc(s->cur, cap);
+    if (tmp == NULL)
+    { goto handle_error; }
+    s->cur    = tmp;
+    s->curcap = cap;
+  }
+
+  memcpy(s->cur + s->cursize, &len, sizeof(uint32_t));
+  memcpy(s->cur + s->cursize + sizeof(uint32_t), record, size);
+  s->cur[s->cursize + sizeof(uint32_t) + size] = '\0';
+  s->cursize  += need;
+  s->curcount += 1;
+
+  if (! s->spill && *s->budget >= need)
+  {
+    *s->budget -= need;
+    s->charged += need;
+  }
+  else
+  { s->spill = 1; }
+
+  if (s->curcount == s->batch && __tbs_flush(s) != 0)
+  { goto handle_error; }
+  return(0);
+
+handle_error:
+  s->error = 1;
+  return(-1);
+}
+
+int tractorbeam_spool_seal(tractorbeam_spool_t *s)
+{
+  if (s->error || __tbs_flush(s) != 0)
+  {
+    s->error = 1;
+    return(-1);
+  }
+
+  free(s->cur);
+  s->cur    = NULL;
+  s->curcap = 0;
+  return(0);
+}
+
+const char *tractorbeam_spool_next(tractorbeam_spool_t *s, size_t *size)
+{
+  tbs_run_t *best = NULL;
+  size_t k;
+
+  if (s->error)
+  { return(NULL); }
+
+  if (! s->sorted)
+  {
+    for (; s->reading < s->nruns; s->reading += 1)
+    {
+      const char *record = __tbs_read(s, &s->runs[s->reading], size);
+      if (record != NULL || s->error)
+      { return(record); }
+    }
+    return(NULL);
+  }
+
+  if (! s->primed)
+  {
+    for (k=0; k<s->nruns; k+=1)
+    { s->runs[k].head = __tbs_read(s, &s->runs[k], &s->runs[k].headlen); }
+    s->primed = 1;
+  }
+  else if (s->last != NULL)
+  { s->last->head = __tbs_read(s, s->last, &s->last->headlen); }
+
+  for (k=0; k<s->nruns; k+=1)
+  {
+    tbs_run_t *run = &s->runs[k];
+    if (run->head == NULL)
+    { continue; }
+    if (best == NULL)
+    { best = run; }
+    else
+    {
+      tbs_record_t x = { run->head, (uint32_t) run->headlen };
+      tbs_record_t y = { best->head, (uint32_t) best->headlen };
+      if (__tbs_compare(&x, &y) < 0)
+      { best = run; }
+    }
+  }
+
+  s->last = best;
+  if (best == NULL || s->error)
+  { return(NULL); }
+  *size = best->headlen;
+  return(best->head);
+}
+
+int tractorbeam_spool_error(tractorbeam_spool_t *s)
+{ return(s->error); }
+
+void tractorbeam_spool_term(tractorbeam_spool_t *s)
+{
+  for (size_t k=0; k<s->nruns; k+=1)
+  { __tbs_release(s, &s->runs[k]); }
+  *s->budget += s->charged;
+  if (s->fd != -1)
+  { close(s->fd); }
+  free(s->runs);
+  free(s->cur);
+  free(s);
+}
@@ -0,0 +1,90 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_spool_h__
+#define __tractorbeam_spool_h__
+
+#include <stdlib.h>
+
+typedef struct tractorbeam_spool_t tractorbeam_spool_t;
+
+/*! Creates a spool, a write-once read-once sequence of records.
+ *
+ * Records are grouped in batches of a fixed number of records. Each
+ * batch stays in memory while the budget allows and goes into an
+ * (unlinked) temporary file otherwise. Batches are released as soon
+ * as all their records have been read, returning the memory to the
+ * budget.
+ *
+ * \param budget The number of bytes this spool may keep in memory. It
+ *               may be shared among many spools and must outlive them;
+ *
+ * \param batch The number of records per batch;
+ *
+ * \param sorted When true records are returned in ascending order
+ *               (as compared by memcmp) using an external merge;
+ *
+ * \return The spool or NULL if there was any error;
+ */
+tractorbeam_spool_t *tractorbeam_spool_init(size_t *budget, size_t batch, int sorted);
+
+/*! Appends a record (it gets copied).
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_spool_push(tractorbeam_spool_t *, const void *record, size_t size);
+
+/*! Finishes writing. Must be called before the first read.
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_spool_seal(tractorbeam_spool_t *);
+
+/*! Reads the next record.
+ *
+ * \param size The size of the record returned;
+ *
+ * \return The record, which remains valid until the next call, or
+ *         NULL when there are no more records (or there was an error,
+ *         see tractorbeam_spool_error). Records are always followed by
+ *         a '\0' that is not accounted in size;
+ */
+const char *tractorbeam_spool_next(tractorbeam_spool_t *, size_t *size);
+
+/*! Tells whether any operation on this spool has failed.
+ */
+int tractorbeam_spool_error(tractorbeam_spool_t *);
+
+/*! Free all resources used by this spool.
+ */
+void tractorbeam_spool_term(tractorbeam_spool_t *);
+
+#endif
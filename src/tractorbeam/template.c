@@ -0,0 +1,504 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "tractorbeam/exec.h"
+#include "tractorbeam/debug.h"
+#include "tractorbeam/helpers.h"
+#include "tractorbeam/template.h"
+
+#define TBTPL_HOOK_TIMEOUT 60
+#define TBTPL_HOOK_OUTPUT 65536
+
+typedef enum
+{
+  TBTPL_TEXT,
+  TBTPL_VALUE,
+  TBTPL_NAME,
+  TBTPL_EACH,
+  TBTPL_IF,
+  TBTPL_UNLESS,
+  TBTPL_END
+} tbtpl_op_e;
+
+typedef struct
+{
+  tbtpl_op_e op;
+  const char *arg;
+  size_t arglen;
+  size_t end;
+} tbtpl_token_t;
+
+/* Paths of nested blocks are kept in cur, one after the other, each
+ * block knowing only the offset and length of its own. */
+struct tractorbeam_template_t
+{
+  char *spec;
+  const char *src;
+  const char *dst;
+  const char *cmd;
+  char *source;
+  size_t sourcesize;
+  tbtpl_token_t *tokens;
+  size_t ntokens;
+  size_t tokencap;
+  char *out;
+  size_t outsize;
+  size_t outlen;
+  char *cur;
+  size_t cursize;
+  char *lookup;
+  size_t lookupsize;
+};
+
+static
+int __tbtpl_push(tractorbeam_template_t *t, tbtpl_op_e op, const char *arg, size_t arglen)
+{
+  if (t->ntokens == t->tokencap)
+  {
+    size_t cap         = (t->tokencap == 0) ? 64 : t->tokencap * 2;
+    tbtpl_token_t *tmp = (tbtpl_token_t *) realloc(t->tokens, sizeof(tbtpl_token_t) * cap);
+    if (tmp == NULL)
+    { return(-1); }
+    t->tokens   = tmp;
+    t->tokencap = cap;
+  }
+  t->tokens[t->ntokens].op     = op;
+  t->tokens[t->ntokens].arg    = arg;
+  t->tokens[t->ntokens].arglen = arglen;
+  t->tokens[t->ntokens].end    = 0;
+  t->ntokens += 1;
+  return(0);
+}
+
+static
+int __tbtpl_line(const tractorbeam_template_t *t, const char *p)
+{
+  int line = 1;
+  const char *q;
+  for (q=t->source; q<p; q+=1)
+  { line += (q[0] == '\n'); }
+  return(line);
+}
+
+static
+int __tbtpl_prefix(const char *tag, size_t taglen, const char *prefix, const char **arg, size_t *arglen)
+{
+  size_t plen = strlen(prefix);
+  if (taglen <= plen || strncmp(tag, prefix, plen) != 0)
+  { return(0); }
+  for (*arg = tag + plen, *arglen = taglen - plen; *arglen > 0 && (*arg)[0] == ' '; *arg += 1, *arglen -= 1)
+  { }
+  return(*arglen > 0);
+}
+
+static
+int __tbtpl_parse(tractorbeam_template_t *t)
+{
+  const char *p   = t->source;
+  const char *end = t->source + t->sourcesize;
+  size_t *open    = NULL;
+  size_t nopen    = 0;
+  int rc          = -1;
+
+  // every {{end}} needs a block, so there are never more than this
+  open = (size_t *) malloc(sizeof(size_t) * (t->sourcesize / 4 + 1));
+  if (open == NULL)
+  { return(-1); }
+
+  while (p < end)
+  {
+    const char *tag = strstr(p, "{{");
+    if (tag == NULL)
+    { tag = end; }
+    if (tag > p && __tbtpl_push(t, TBTPL_TEXT, p, (size_t) (tag - p)) != 0)
+    { goto handle_error; }
+    if (tag == end)
+    { break; }
+
+    const char *close = strstr(tag + 2, "}}");
+    if (close == NULL)
+    {
+      TB_DEBUG("%s:%d: unterminated tag", t->src, __tbtpl_line(t, tag));
+      goto handle_error;
+    }
+    const char *arg, *body = tag + 2;
+    size_t arglen, bodylen = (size_t) (close - body);
+    for (; bodylen > 0 && body[0] == ' '; body++, bodylen--)
+    { }
+    for (; bodylen > 0 && body[bodylen - 1] == ' '; bodylen--)
+    { }
+
+    int rc1;
+    if (bodylen > 0 && (body[0] == '/' || body[0] == '.'))
+    { rc1 = __tbtpl_push(t, TBTPL_VALUE, body, bodylen); }
+    else if (bodylen == 5 && strncmp(body, "@name", 5) == 0)
+    { rc1 = __tbtpl_push(t, TBTPL_NAME, NULL, 0); }
+    else if (__tbtpl_prefix(body, bodylen, "#each ", &arg, &arglen))
+    {
+      open[nopen++] = t->ntokens;
+      rc1           = __tbtpl_push(t, TBTPL_EACH, arg, arglen);
+    }
+    else if (__tbtpl_prefix(body, bodylen, "#if ", &arg, &arglen))
+    {
+      open[nopen++] = t->ntokens;
+      rc1           = __tbtpl_push(t, TBTPL_IF, arg, arglen);
+    }
+    else if (__tbtpl_prefix(body, bodylen, "#unless ", &arg, &arglen))
+    {
+      open[nopen++] = t->ntokens;
+      rc1           = __tbtpl_push(t, TBTPL_UNLESS, arg, arglen);
+    }
+    else if (bodylen == 3 && strncmp(body, "end", 3) == 0 && nopen > 0)
+    {
+      t->tokens[open[--nopen]].end = t->ntokens;
+      rc1                          = __tbtpl_push(t, TBTPL_END, NULL, 0);
+    }
+    else
+    {
+      TB_DEBUG("%s:%d: invalid tag: %.*s", t->src, __tbtpl_line(t, tag), (int) bodylen, body);
+      goto handle_error;
+    }
+    if (rc1 != 0)
+    { goto handle_error; }
+    p = close + 2;
+  }
+
+  if (nopen > 0)
+  {
+    TB_DEBUG("%s:%d: block without {{end}}", t->src, __tbtpl_line(t, t->tokens[open[nopen - 1]].arg));
+    goto handle_error;
+  }
+  rc = 0;
+
+handle_error:
+  free(open);
+  return(rc);
+}
+
+static
+int __tbtpl_append(tractorbeam_template_t *t, const char *data, size_t size)
+{
+  if (tbh_grow(&t->out, &t->outsize, t->outlen + size, 4096, (size_t) -1) != 0)
+  { return(-1); }
+  memcpy(t->out + t->outlen, data, size);
+  t->outlen += size;
+  return(0);
+}
+
+/* Resolves the path of a tag (relative to the current node) into
+ * t->lookup. */
+static
+const char *__tbtpl_resolve(tractorbeam_template_t *t, const tbtpl_token_t *tok, size_t off, size_t len)
+{
+  size_t need = tok->arglen + len + 2;
+  if (tbh_grow(&t->lookup, &t->lookupsize, need, 256, (size_t) -1) != 0)
+  { return(NULL); }
+
+  if (tok->arg[0] == '/')
+  {
+    memcpy(t->lookup, tok->arg, tok->arglen);
+    t->lookup[tok->arglen] = '\0';
+  }
+  else if (len == 0 && tok->arglen == 1)
+  { strcpy(t->lookup, "/"); }
+  else
+  {
+    memcpy(t->lookup, t->cur + off, len);
+    memcpy(t->lookup + len, tok->arg + 1, tok->arglen - 1);
+    t->lookup[len + tok->arglen - 1] = '\0';
+  }
+  return(t->lookup);
+}
+
+static
+int __tbtpl_render(tractorbeam_template_t *t, const tractorbeam_tree_t *tree, size_t from, size_t to, size_t off, size_t len)
+{
+  const char *path, *data, *name;
+  size_t k = from;
+  size_t datasize, first, count, j;
+
+  while (k < to)
+  {
+    const tbtpl_token_t *tok = &t->tokens[k];
+    switch (tok->op)
+    {
+    case TBTPL_TEXT:
+      if (__tbtpl_append(t, tok->arg, tok->arglen) != 0)
+      { return(-1); }
+      k += 1;
+      break;
+
+    case TBTPL_NAME:
+      for (name = t->cur + off + len; name > t->cur + off && name[-1] != '/'; name -= 1)
+      { }
+      if (__tbtpl_append(t, name, (size_t) (t->cur + off + len - name)) != 0)
+      { return(-1); }
+      k += 1;
+      break;
+
+    case TBTPL_VALUE:
+      if ((path = __tbtpl_resolve(t, tok, off, len)) == NULL)
+      { return(-1); }
+      data = tractorbeam_tree_get(tree, path, &datasize);
+      if (data != NULL && __tbtpl_append(t, data, datasize) != 0)
+      { return(-1); }
+      k += 1;
+      break;
+
+    case TBTPL_IF:
+    case TBTPL_UNLESS:
+      if ((path = __tbtpl_resolve(t, tok, off, len)) == NULL)
+      { return(-1); }
+      if ((tractorbeam_tree_get(tree, path, &datasize) != NULL) == (tok->op == TBTPL_IF)
+          && __tbtpl_render(t, tree, k + 1, tok->end, off, len) != 0)
+      { return(-1); }
+      k = tok->end + 1;
+      break;
+
+    case TBTPL_EACH:
+      if ((path = __tbtpl_resolve(t, tok, off, len)) == NULL)
+      { return(-1); }
+      count = tractorbeam_tree_list(tree, path, &first);
+
+      // children go right after the current path, the root being ""
+      size_t newoff  = off + len + 1;
+      size_t baselen = (strcmp(path, "/") == 0) ? 0 : strlen(path);
+      if (tbh_grow(&t->cur, &t->cursize, newoff + baselen + 1, 256, (size_t) -1) != 0)
+      { return(-1); }
+      memcpy(t->cur + newoff, path, baselen);
+      for (j=0; j<count; j+=1)
+      {
+        name        = tractorbeam_tree_name(tree, first + j);
+        size_t nlen = strlen(name);
+        if (tbh_grow(&t->cur, &t->cursize, newoff + baselen + nlen + 2, 256, (size_t) -1) != 0)
+        { return(-1); }
+        t->cur[newoff + baselen] = '/';
+        memcpy(t->cur + newoff + baselen + 1, name, nlen);
+        if (__tbtpl_render(t, tree, k + 1, tok->end, newoff, baselen + nlen + 1) != 0)
+        { return(-1); }
+      }
+      k = tok->end + 1;
+      break;
+
+    case TBTPL_END:
+      k += 1;
+      break;
+    }
+  }
+  return(0);
+}
+
+static
+int __tbtpl_unchanged(const char *file, const char *data, size_t size)
+{
+  char buffer[4096];
+  size_t n, off = 0;
+  int same = 1;
+  FILE *fh = fopen(file, "r");
+  if (fh == NULL)
+  { return(0); }
+
+  while (same && (n = fread(buffer, sizeof(char), sizeof(buffer), fh)) > 0)
+  {
+    same = (off + n <= size && memcmp(buffer, data + off, n) == 0);
+    off += n;
+  }
+  same = same && off == size && ! ferror(fh);
+  fclose(fh);
+  return(same);
+}
+
+static
+int __tbtpl_write(const char *file, const char *data, size_t size)
+{
+  char *tmp = NULL;
+  FILE *fh  = tbh_replace_open(file, &tmp);
+  if (fh == NULL)
+  { return(-1); }
+  int rc = (size == 0 || fwrite(data, sizeof(char), size, fh) == size) ? 0 : -1;
+  return(tbh_replace_close(fh, file, tmp, rc));
+}
+
+static
+int __tbtpl_hook(const char *cmd)
+{
+  char *argv[] = { "/bin/sh", "-c", NULL, NULL };
+  char *out    = NULL;
+  size_t outsz = 0;
+  int status   = 0;
+
+  argv[2] = (char *) cmd;
+  int rc  = tractorbeam_exec("/bin/sh", argv, TBTPL_HOOK_TIMEOUT, &status, &out, &outsz, TBTPL_HOOK_OUTPUT);
+  free(out);
+  if (rc == -2)
+  {
+    TB_DEBUG("%s: timeout", cmd);
+    return(-1);
+  }
+  else if (rc < 0 && rc != -3)
+  {
+    TB_DEBUG("%s: error running", cmd);
+    return(-1);
+  }
+  else if (status != 0)
+  {
+    TB_DEBUG("%s: exit code == %d", cmd, status);
+    return(-1);
+  }
+  return(0);
+}
+
+tractorbeam_template_t *tractorbeam_template_init(const char *spec)
+{
+  tractorbeam_template_t *t = (tractorbeam_template_t *) malloc(sizeof(tractorbeam_template_t));
+  if (t == NULL)
+  { return(NULL); }
+  memset(t, 0, sizeof(tractorbeam_template_t));
+
+  // SRC:DST[:CMD], the command may have colons
+  t->spec = tbh_strdup(spec);
+  char *sep1 = (t->spec == NULL) ? NULL : strchr(t->spec, ':');
+  if (sep1 == NULL || sep1 == t->spec || sep1[1] == '\0' || sep1[1] == ':')
+  {
+    TB_DEBUG("invalid template (SRC:DST[:CMD]): %s", spec);
+    tractorbeam_template_term(t);
+    return(NULL);
+  }
+  sep1[0]    = '\0';
+  char *sep2 = strchr(sep1 + 1, ':');
+  if (sep2 != NULL)
+  {
+    sep2[0] = '\0';
+    t->cmd  = (sep2[1] == '\0') ? NULL : sep2 + 1;
+  }
+  t->src = t->spec;
+  t->dst = sep1 + 1;
+
+  FILE *fh   = fopen(t->src, "r");
+  size_t len = 0;
+  int rc     = -1;
+  if (fh != NULL)
+  {
+    size_t n = 4096;
+    while (n == 4096 && (rc = tbh_grow(&t->source, &t->sourcesize, len + 4097, 4097, (size_t) -1)) == 0)
+    {
+      n    = fread(t->source + len, sizeof(char), 4096, fh);
+      len += n;
+    }
+    if (ferror(fh))
+    { rc = -1; }
+    fclose(fh);
+  }
+  if (rc != 0 || tbh_grow(&t->cur, &t->cursize, 256, 256, (size_t) -1) != 0)
+  {
+    TB_DEBUG("could not read template: %s", t->src);
+    tractorbeam_template_term(t);
+    return(NULL);
+  }
+  t->source[len] = '\0';
+  t->sourcesize  = len;
+
+  if (__tbtpl_parse(t) != 0)
+  {
+    tractorbeam_template_term(t);
+    return(NULL);
+  }
+  return(t);
+}
+
+/* The command runs once dst is in place, as it usually reads it. A
+ * marker (dst.pending) exists from before dst gets replaced until the
+ * command succeeds, so that a failed command is run again by the next
+ * render, even if dst has not changed by then.
+ */
+static
+int __tbtpl_reload(tractorbeam_template_t *t, int changed)
+{
+  struct stat st;
+  int rc        = -1;
+  char *pending = tbh_join(t->dst, ".pending", NULL);
+  if (pending == NULL)
+  { return(-1); }
+
+  if (! changed && stat(pending, &st) != 0)
+  { rc = 0; }
+  else if (changed && (__tbtpl_write(pending, "", 0) != 0 || __tbtpl_write(t->dst, t->out, t->outlen) != 0))
+  { rc = -1; }
+  else
+  {
+    if (changed)
+    { TB_DEBUG("rendered: %s", t->dst); }
+    else
+    { TB_DEBUG("retrying command: %s", t->cmd); }
+    rc = __tbtpl_hook(t->cmd);
+    if (rc == 0)
+    { unlink(pending); }
+  }
+
+  free(pending);
+  return(rc);
+}
+
+int tractorbeam_template_render(tractorbeam_template_t *t, const tractorbeam_tree_t *tree)
+{
+  t->outlen = 0;
+  if (__tbtpl_render(t, tree, 0, t->ntokens, 0, 0) != 0)
+  { return(-1); }
+
+  int changed = ! __tbtpl_unchanged(t->dst, t->out, t->outlen);
+  if (t->cmd != NULL)
+  {
+    if (__tbtpl_reload(t, changed) != 0)
+    { return(-1); }
+  }
+  else if (changed)
+  {
+    if (__tbtpl_write(t->dst, t->out, t->outlen) != 0)
+    { return(-1); }
+    TB_DEBUG("rendered: %s", t->dst);
+  }
+  return(changed);
+}
+
+void tractorbeam_template_term(tractorbeam_template_t *t)
+{
+  if (t == NULL)
+  { return; }
+  free(t->spec);
+  free(t->source);
+  free(t->tokens);
+  free(t->out);
+  free(t->cur);
+  free(t->lookup);
+  free(t);
+}
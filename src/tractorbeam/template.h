@@ -0,0 +1,75 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_template_h__
+#define __tractorbeam_template_h__
+
+#include "tractorbeam/tree.h"
+
+/* Templates are plain text with the following tags:
+ *
+ *   {{/a/path}}          the contents of a node (nothing if missing);
+ *   {{.}}, {{./a/path}}  the same, relative to the current node;
+ *   {{@name}}            the name of the current node;
+ *   {{#each PATH}}       repeats the block (up to {{end}}) for each
+ *                        child of PATH (in ascending order), which
+ *                        becomes the current node;
+ *   {{#if PATH}}         renders the block if PATH exists;
+ *   {{#unless PATH}}     renders the block if PATH does not exist;
+ *   {{end}}              ends a block;
+ */
+typedef struct tractorbeam_template_t tractorbeam_template_t;
+
+/*! Reads and parses a template.
+ *
+ * \param spec SRC:DST[:CMD], i.e. the template, the file to render
+ *             it into and the command to run (by /bin/sh) when the
+ *             file changes;
+ *
+ * \return The template or NULL if there was any error;
+ */
+tractorbeam_template_t *tractorbeam_template_init(const char *spec);
+
+/*! Renders the template, replacing the destination file (atomically)
+ *  and running the command only if the output has changed.
+ *
+ * A command that has failed is run again by the following renders,
+ * until it succeeds, even if the output has not changed since.
+ *
+ * \return 0: the output has not changed;
+ *
+ * \return 1: the output has changed;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_template_render(tractorbeam_template_t *, const tractorbeam_tree_t *tree);
+
+/*! Free all resources used by this template.
+ */
+void tractorbeam_template_term(tractorbeam_template_t *);
+
+#endif
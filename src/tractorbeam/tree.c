@@ -0,0 +1,275 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <stdlib.h>
+#include "tractorbeam/tree.h"
+#include "tractorbeam/helpers.h"
+
+#define TBT_ARENA_MIN 65536
+
+/* Strings and contents live in a single arena, which moves while it
+ * grows. Nodes refer to it by offset until the tree gets sealed and
+ * by pointer afterwards. */
+typedef union
+{
+  size_t off;
+  const char *ptr;
+} tbt_ref_t;
+
+typedef struct
+{
+  tbt_ref_t parent;
+  size_t parentlen;
+  tbt_ref_t name;
+  size_t namelen;
+  tbt_ref_t data;
+  size_t datasize;
+} tbt_node_t;
+
+struct tractorbeam_tree_t
+{
+  char *arena;
+  size_t arenasize;
+  size_t arenacap;
+  tbt_node_t *nodes;
+  size_t count;
+  size_t cap;
+};
+
+static
+int __tbt_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+  int rc = memcmp(a, b, (alen < blen) ? alen : blen);
+  if (rc != 0)
+  { return(rc); }
+  return((alen > blen) - (alen < blen));
+}
+
+static
+int __tbt_compare(const void *a, const void *b)
+{
+  const tbt_node_t *x = (const tbt_node_t *) a;
+  const tbt_node_t *y = (const tbt_node_t *) b;
+  int rc = __tbt_cmp(x->parent.ptr, x->parentlen, y->parent.ptr, y->parentlen);
+  if (rc != 0)
+  { return(rc); }
+  return(__tbt_cmp(x->name.ptr, x->namelen, y->name.ptr, y->namelen));
+}
+
+/* First node not less than (parent, name). */
+static
+size_t __tbt_lower(const tractorbeam_tree_t *t, const char *parent, size_t parentlen, const char *name, size_t namelen)
+{
+  size_t lo = 0, hi = t->count;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    const tbt_node_t *n = &t->nodes[mid];
+    int rc = __tbt_cmp(n->parent.ptr, n->parentlen, parent, parentlen);
+    if (rc == 0)
+    { rc = __tbt_cmp(n->name.ptr, n->namelen, name, namelen); }
+    if (rc < 0)
+    { lo = mid + 1; }
+    else
+    { hi = mid; }
+  }
+  return(lo);
+}
+
+/* Splits an absolute path into parent and name ("/" is parent "" and
+ * name ""). */
+static
+void __tbt_split(const char *path, const char **parent, size_t *parentlen, const char **name, size_t *namelen)
+{
+  size_t len        = strlen(path);
+  const char *slash = strrchr(path, '/');
+  if (slash == NULL || len <= 1)
+  {
+    *parent    = "";
+    *parentlen = 0;
+    *name      = "";
+    *namelen   = 0;
+  }
+  else
+  {
+    *parent    = path;
+    *parentlen = (slash == path) ? 1 : (size_t) (slash - path);
+    *name      = slash + 1;
+    *namelen   = len - (size_t) (slash - path) - 1;
+  }
+}
+
+static
+const tbt_node_t *__tbt_find(const tractorbeam_tree_t *t, const char *path)
+{
+  const char *parent, *name;
+  size_t parentlen, namelen;
+
+  __tbt_split(path, &parent, &parentlen, &name, &namelen);
+  size_t k = __tbt_lower(t, parent, parentlen, name, namelen);
+  if (k < t->count
+      && __tbt_cmp(t->nodes[k].parent.ptr, t->nodes[k].parentlen, parent, parentlen) == 0
+      && __tbt_cmp(t->nodes[k].name.ptr, t->nodes[k].namelen, name, namelen) == 0)
+  { return(&t->nodes[k]); }
+  return(NULL);
+}
+
+static
+size_t __tbt_push(tractorbeam_tree_t *t, const void *data, size_t size)
+{
+  size_t offset = t->arenasize;
+  memcpy(t->arena + offset, data, size);
+  t->arena[offset + size] = '\0';
+  t->arenasize += size + 1;
+  return(offset);
+}
+
+tractorbeam_tree_t *tractorbeam_tree_init(void)
+{
+  tractorbeam_tree_t *t = (tractorbeam_tree_t *) malloc(sizeof(tractorbeam_tree_t));
+  if (t != NULL)
+  {
+    t->arena     = NULL;
+    t->arenasize = 0;
+    t->arenacap  = 0;
+    t->nodes     = NULL;
+    t->count     = 0;
+    t->cap       = 0;
+  }
+  return(t);
+}
+
+int tractorbeam_tree_add(tractorbeam_tree_t *t, const char *ppath, const char *name, const void *data, size_t datasize)
+{
+  // the children of the root node are given with ppath ""
+  const char *parent = (ppath[0] == '\0' && name[0] != '\0') ? "/" : ppath;
+  size_t parentlen   = strlen(parent);
+  size_t namelen     = strlen(name);
+  size_t need        = t->arenasize + parentlen + namelen + datasize + 3;
+
+  if (need < t->arenasize || tbh_grow(&t->arena, &t->arenacap, need, TBT_ARENA_MIN, (size_t) -1) != 0)
+  { return(-1); }
+
+  if (t->count == t->cap)
+  {
+    size_t cap      = (t->cap == 0) ? 1024 : t->cap * 2;
+    tbt_node_t *tmp = (tbt_node_t *) realloc(t->nodes, sizeof(tbt_node_t) * cap);
+    if (tmp == NULL)
+    { return(-1); }
+    t->nodes = tmp;
+    t->cap   = cap;
+  }
+
+  tbt_node_t *n = &t->nodes[t->count];
+  n->parent.off = __tbt_push(t, parent, parentlen);
+  n->parentlen  = parentlen;
+  n->name.off   = __tbt_push(t, name, namelen);
+  n->namelen    = namelen;
+  n->data.off   = __tbt_push(t, (data == NULL) ? "" : data, (data == NULL) ? 0 : datasize);
+  n->datasize   = (data == NULL) ? 0 : datasize;
+  t->count     += 1;
+  return(0);
+}
+
+void tractorbeam_tree_seal(tractorbeam_tree_t *t)
+{
+  size_t k;
+  for (k=0; k<t->count; k+=1)
+  {
+    tbt_node_t *n = &t->nodes[k];
+    n->parent.ptr = t->arena + n->parent.off;
+    n->name.ptr   = t->arena + n->name.off;
+    n->data.ptr   = t->arena + n->data.off;
+  }
+  if (t->count > 0)
+  { qsort(t->nodes, t->count, sizeof(tbt_node_t), __tbt_compare); }
+}
+
+size_t tractorbeam_tree_count(const tractorbeam_tree_t *t)
+{ return(t->count); }
+
+const char *tractorbeam_tree_get(const tractorbeam_tree_t *t, const char *path, size_t *datasize)
+{
+  const tbt_node_t *n = __tbt_find(t, path);
+  if (n == NULL)
+  { return(NULL); }
+  *datasize = n->datasize;
+  return(n->data.ptr);
+}
+
+size_t tractorbeam_tree_list(const tractorbeam_tree_t *t, const char *path, size_t *first)
+{
+  size_t pathlen = strlen(path);
+  size_t k       = __tbt_lower(t, path, pathlen, "", 0);
+
+  // the root node is the only one having an empty name
+  if (pathlen == 0)
+  { k = t->count; }
+  *first = k;
+  while (k < t->count && __tbt_cmp(t->nodes[k].parent.ptr, t->nodes[k].parentlen, path, pathlen) == 0)
+  { k += 1; }
+  return(k - *first);
+}
+
+const char *tractorbeam_tree_name(const tractorbeam_tree_t *t, size_t k)
+{ return(t->nodes[k].name.ptr); }
+
+int tractorbeam_tree_same(const tractorbeam_tree_t *a, const tractorbeam_tree_t *b, const char *path)
+{
+  const tbt_node_t *x = (a == NULL) ? NULL : __tbt_find(a, path);
+  const tbt_node_t *y = (b == NULL) ? NULL : __tbt_find(b, path);
+  size_t xfirst, yfirst, k;
+
+  if (x == NULL || y == NULL)
+  { return(x == y); }
+  if (__tbt_cmp(x->data.ptr, x->datasize, y->data.ptr, y->datasize) != 0)
+  { return(0); }
+
+  size_t xcount = tractorbeam_tree_list(a, path, &xfirst);
+  size_t ycount = tractorbeam_tree_list(b, path, &yfirst);
+  if (xcount != ycount)
+  { return(0); }
+  for (k=0; k<xcount; k+=1)
+  {
+    const tbt_node_t *xc = &a->nodes[xfirst + k];
+    const tbt_node_t *yc = &b->nodes[yfirst + k];
+    if (__tbt_cmp(xc->name.ptr, xc->namelen, yc->name.ptr, yc->namelen) != 0)
+    { return(0); }
+  }
+  return(1);
+}
+
+void tractorbeam_tree_term(tractorbeam_tree_t *t)
+{
+  if (t != NULL)
+  {
+    free(t->arena);
+    free(t->nodes);
+    free(t);
+  }
+}
@@ -0,0 +1,101 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_tree_h__
+#define __tractorbeam_tree_h__
+
+#include <stdlib.h>
+
+typedef struct tractorbeam_tree_t tractorbeam_tree_t;
+
+/*! Creates an empty in-memory copy of a zookeeper tree.
+ *
+ * Nodes are added (in any order) and the tree is sealed before the
+ * first lookup. Lookups are binary searches over a single array,
+ * sorted by parent and then name, so the children of a node are
+ * always contiguous.
+ *
+ * \return The tree or NULL if there was any error;
+ */
+tractorbeam_tree_t *tractorbeam_tree_init(void);
+
+/*! Adds a node (arguments as given to tb_snapshot_fn).
+ *
+ * \param ppath The path of the parent node ("" for the children of
+ *              the root node);
+ *
+ * \param name The name of the node ("" along with ppath "" means the
+ *             root node);
+ *
+ * \return 0: success;
+ *
+ * \return -1: error;
+ */
+int tractorbeam_tree_add(tractorbeam_tree_t *, const char *ppath, const char *name, const void *data, size_t datasize);
+
+/*! Sorts the nodes. No nodes may be added after this and no lookups
+ *  may be done before this.
+ */
+void tractorbeam_tree_seal(tractorbeam_tree_t *);
+
+/*! The number of nodes.
+ */
+size_t tractorbeam_tree_count(const tractorbeam_tree_t *);
+
+/*! Finds a node.
+ *
+ * \param path The absolute path of the node;
+ *
+ * \param datasize The size of the contents;
+ *
+ * \return The contents of the node (not '\0' terminated) or NULL if
+ *         there is no such node;
+ */
+const char *tractorbeam_tree_get(const tractorbeam_tree_t *, const char *path, size_t *datasize);
+
+/*! Finds the children of a node.
+ *
+ * \param first Index of the first child (see tractorbeam_tree_name);
+ *
+ * \return The number of children;
+ */
+size_t tractorbeam_tree_list(const tractorbeam_tree_t *, const char *path, size_t *first);
+
+/*! The name of the k-th node ('\0' terminated).
+ */
+const char *tractorbeam_tree_name(const tractorbeam_tree_t *, size_t k);
+
+/*! Tells whether a node (its contents and the names of its children)
+ *  is the same in both trees. Nodes missing in both are the same.
+ */
+int tractorbeam_tree_same(const tractorbeam_tree_t *, const tractorbeam_tree_t *, const char *path);
+
+/*! Free all resources used by this tree.
+ */
+void tractorbeam_tree_term(tractorbeam_tree_t *);
+
+#endif
@@ -0,0 +1,203 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+# include <sys/inotify.h>
+#endif
+#include "tractorbeam/debug.h"
+#include "tractorbeam/watch.h"
+#include "tractorbeam/helpers.h"
+
+#define TBW_BUFFER_MIN 4096
+#define TBW_EVENTS_SIZE 4096
+#define TBW_EVENTS (IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct tractorbeam_watch_t
+{
+  int fd;
+  char *name;
+};
+
+#ifdef __linux__
+static
+int __tbw_events(tractorbeam_watch_t *wh)
+{
+  union
+  {
+    struct inotify_event align;
+    char data[TBW_EVENTS_SIZE];
+  } events;
+  int changed = 0;
+
+  ssize_t len = read(wh->fd, events.data, TBW_EVENTS_SIZE);
+  if (len == -1)
+  { return((errno == EINTR || errno == EAGAIN) ? 0 : -1); }
+
+  for (char *p = events.data; p < events.data + len; )
+  {
+    struct inotify_event *ev = (struct inotify_event *) p;
+    if (ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF))
+    { return(-1); }
+    if (ev->len > 0 && strcmp(ev->name, wh->name) == 0)
+    { changed = 1; }
+    p += sizeof(struct inotify_event) + ev->len;
+  }
+
+  return(changed);
+}
+#endif
+
+tractorbeam_watch_t *tractorbeam_watch_init(const char *file)
+{
+#ifdef __linux__
+  const char *slash = strrchr(file, '/');
+  char *dir         = NULL;
+  if (slash == NULL)
+  { dir = tbh_strdup("."); }
+  else if (slash == file)
+  { dir = tbh_strdup("/"); }
+  else
+  {
+    dir = tbh_strdup(file);
+    if (dir != NULL)
+    { dir[slash - file] = '\0'; }
+  }
+
+  tractorbeam_watch_t *wh = (tractorbeam_watch_t *) malloc(sizeof(tractorbeam_watch_t));
+  if (wh == NULL || dir == NULL)
+  {
+    free(wh);
+    free(dir);
+    return(NULL);
+  }
+
+  wh->name = tbh_strdup(slash == NULL ? file : slash + 1);
+  wh->fd   = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (wh->fd == -1 || wh->name == NULL || wh->name[0] == '\0'
+      || inotify_add_watch(wh->fd, dir, TBW_EVENTS) == -1)
+  {
+    TB_DEBUG("%s: could not watch directory", dir);
+    free(dir);
+    tractorbeam_watch_term(wh);
+    return(NULL);
+  }
+
+  free(dir);
+  return(wh);
+#else
+  UNUSED(file);
+  TB_DEBUG0("watching files is not supported on this platform");
+  return(NULL);
+#endif
+}
+
+int tractorbeam_watch_wait(tractorbeam_watch_t *wh, int timeout_in_ms)
+{
+#ifdef __linux__
+  struct pollfd pfd;
+  pfd.fd     = wh->fd;
+  pfd.events = POLLIN;
+
+  int rc = poll(&pfd, 1, timeout_in_ms);
+  if (rc == -1)
+  { return(errno == EINTR ? 0 : -1); }
+  else if (rc == 0)
+  { return(0); }
+  return(__tbw_events(wh));
+#else
+  UNUSED(wh);
+  UNUSED(timeout_in_ms);
+  return(-1);
+#endif
+}
+
+void tractorbeam_watch_term(tractorbeam_watch_t *wh)
+{
+  if (wh != NULL)
+  {
+    if (wh->fd != -1)
+    { close(wh->fd); }
+    free(wh->name);
+    free(wh);
+  }
+}
+
+static
+int __tbw_read(int fd, char **out, size_t *outsz, size_t maxsz)
+{
+  struct stat st;
+  size_t offset = 0;
+
+  // maxsz + 1 lets a read past the limit tell larger files apart
+  if (fstat(fd, &st) != 0)
+  { return(-1); }
+  if (S_ISREG(st.st_mode) && (size_t) st.st_size > maxsz)
+  { return(-3); }
+  if (S_ISREG(st.st_mode) && tbh_grow(out, outsz, (size_t) st.st_size + 1, TBW_BUFFER_MIN, maxsz + 1) != 0)
+  { return(-1); }
+
+  while (1)
+  {
+    if (offset == *outsz && tbh_grow(out, outsz, offset + 1, TBW_BUFFER_MIN, maxsz + 1) != 0)
+    { return(-1); }
+
+    ssize_t r = read(fd, *out + offset, *outsz - offset);
+    if (r == 0)
+    { break; }
+    else if (r == -1 && errno == EINTR)
+    { continue; }
+    else if (r == -1)
+    { return(-1); }
+
+    offset += (size_t) r;
+    if (offset > maxsz)
+    { return(-3); }
+  }
+
+  return((int) offset);
+}
+
+int tractorbeam_watch_read(const char *file, char **out, size_t *outsz, size_t maxsz)
+{
+  int fd = open(file, O_RDONLY);
+  if (fd == -1)
+  { return(errno == ENOENT ? -2 : -1); }
+
+  int rc = __tbw_read(fd, out, outsz, maxsz);
+  close(fd);
+  return(rc);
+}
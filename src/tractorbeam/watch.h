@@ -0,0 +1,90 @@
+// All rights reserved.
+//  
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//  
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//  
+// * Redistributions in binary form must reproduce the above copyright notice, this
+//   list of conditions and the following disclaimer in the documentation and/or
+//   other materials provided with the distribution.
+//  
+// * Neither the name of the {organization} nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//  
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef __tractorbeam_watch_h__
+#define __tractorbeam_watch_h__
+
+#include <stdlib.h>
+
+typedef struct tractorbeam_watch_t tractorbeam_watch_t;
+
+/*! Watches a file for changes.
+ *
+ * The directory of the file is watched (inotify), so that files
+ * replaced by a rename are also noticed. This is only available on
+ * linux.
+ *
+ * \param file The file to watch (it may not exist yet);
+ *
+ * \return The watch handle or NULL if there was any error;
+ */
+tractorbeam_watch_t *tractorbeam_watch_init(const char *file);
+
+/*! Waits until the file changes.
+ *
+ * A change is either a writer closing the file, the file being
+ * renamed into place, or removed. Creating the file is not a change
+ * by itself, as it has no contents until the writer closes it.
+ *
+ * \param timeout_in_ms How long to wait at most (-1 waits forever);
+ *
+ * \return 1: the file has changed;
+ *
+ * \return 0: timeout;
+ *
+ * \return -1: error (the directory is gone, for instance);
+ */
+int tractorbeam_watch_wait(tractorbeam_watch_t *, int timeout_in_ms);
+
+/*! Free all resources used by this handle.
+ */
+void tractorbeam_watch_term(tractorbeam_watch_t *);
+
+/*! Reads the contents of a file.
+ *
+ * \param file The file to read. When this is a fifo, this blocks
+ *             until a writer opens it and returns what has been
+ *             written until all writers close it;
+ *
+ * \param out The buffer that gets the contents. It grows as needed
+ *            (realloc) and may be NULL initially;
+ *
+ * \param outsz The size of the out buffer, updated when it grows;
+ *
+ * \param maxsz The maximum size the out buffer may grow to;
+ *
+ * \return >=0 The number of bytes read;
+ *
+ * \return -1 Error reading the file;
+ *
+ * \return -2 The file does not exist;
+ *
+ * \return -3 The file is larger than maxsz;
+ */
+int tractorbeam_watch_read(const char *file, char **out, size_t *outsz, size_t maxsz);
+
+#endif
@@ -25,22 +25,36 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include "tractorbeam/shm.h"
+#include "tractorbeam/json.h"
+#include "tractorbeam/tree.h"
 #include "tractorbeam/debug.h"
+#include "tractorbeam/digest.h"
+#include "tractorbeam/datadir.h"
+#include "tractorbeam/probe.h"
+#include "tractorbeam/fswriter.h"
+#include "tractorbeam/template.h"
 #include "tractorbeam/zkrecv.h"
 #include "tractorbeam/helpers.h"
 #include "tractorbeam/monitor.h"
 
+#define ZKRECV_WRITE_BUFSIZE 1048576
+#define ZKRECV_FSWRITER_MEMORY 16777216
+
 static
-int __tbzkrcv_filesystem_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, void *data)
+int __tbzkrcv_filesystem_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
 {
   char *chdir = (char *) data;
   char *dir   = NULL;
   char *file  = NULL;
   FILE *fd    = NULL;
   int rc      = -1;
+  UNUSED(stat);
   if (event == DONE)
   { return(0); }
   else if (event != ITEM)
@@ -57,7 +71,7 @@ int __tbzkrcv_filesystem_cc(tb_snapshot_events event, const char *ppath, const c
     file = tbh_join(chdir, "/", ppath, "/", name, ".data", NULL);
     if (file != NULL && (fd = fopen(file, "w")) != NULL)
     {
-      if (fwrite(contents, sizeof(char), contsize, fd) > 0)
+      if (contsize == 0 || fwrite(contents, sizeof(char), contsize, fd) > 0)
       { rc = 0; }
       fclose(fd);
     }
@@ -73,10 +87,42 @@ int __tbzkrcv_filesystem_cc(tb_snapshot_events event, const char *ppath, const c
   return(rc);
 }
 
+typedef struct
+{
+  const char *output;
+  tractorbeam_fswriter_t *writer;
+} tbzkrcv_fs_t;
+
+/* The same as __tbzkrcv_filesystem_cc, but the files get written in
+ * the background while the walk goes on. */
 static
-int __tbzkrcv_file_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, void *data)
+int __tbzkrcv_fswriter_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  tbzkrcv_fs_t *fs = (tbzkrcv_fs_t *) data;
+  char *file       = NULL;
+  int rc           = -1;
+  UNUSED(stat);
+  if (event == DONE)
+  { return(0); }
+  else if (event != ITEM)
+  { return(-1); }
+
+  char *dir = tbh_join(fs->output, "/", ppath, "/", name, NULL);
+  if (contents != 0)
+  { file = tbh_join(fs->output, "/", ppath, "/", name, ".data", NULL); }
+  if (dir != NULL && (contents == 0 || file != NULL))
+  { rc = tractorbeam_fswriter_put(fs->writer, dir, file, contents, contsize); }
+
+  free(dir);
+  free(file);
+  return(rc);
+}
+
+static
+int __tbzkrcv_file_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
 {
   FILE *file = (FILE *) data;
+  UNUSED(stat);
   if (event == DONE)
   { return(0); }
   else if (event != ITEM)
@@ -86,7 +132,7 @@ int __tbzkrcv_file_cc(tb_snapshot_events event, const char *ppath, const char *n
   {
     if (fprintf(file, "%s/%s|%zd\n", ppath, name, contsize) > 0 &&
         fwrite(contents, sizeof(char), contsize, file) > 0 &&
-        fprintf(file, "\n") > 0)
+        putc('\n', file) != EOF)
     { return(0); }
     return(-1);
   }
@@ -94,37 +140,528 @@ int __tbzkrcv_file_cc(tb_snapshot_events event, const char *ppath, const char *n
   return(0);
 }
 
-int tractorbeam_zkrecv(tractorbeam_zkrecv_t *info)
+static
+int __tbzkrcv_stat_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
 {
-  tractorbeam_monitor_t *mh = tractorbeam_monitor_init(info->endpoint, info->path, info->timeout);
+  FILE *file = (FILE *) data;
+  UNUSED(contents);
+  UNUSED(contsize);
+  if (event == DONE)
+  { return(0); }
+  else if (event != ITEM || stat == NULL)
+  { return(-1); }
+
+  if (fprintf(file, "%s/%s|%d|%d|%d|0x%llx|0x%llx|0x%llx|%lld|%lld|0x%llx|%d|%d\n", ppath, name,
+              stat->version, stat->cversion, stat->aversion,
+              (unsigned long long) stat->czxid, (unsigned long long) stat->mzxid, (unsigned long long) stat->pzxid,
+              (long long) stat->ctime, (long long) stat->mtime, (unsigned long long) stat->ephemeral_owner,
+              stat->data_length, stat->num_children) > 0)
+  { return(0); }
+  return(-1);
+}
+
+/* One object per line. Contents are written as a string if they are
+ * UTF-8 and as base64 otherwise. */
+static
+int __tbzkrcv_json_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  FILE *file = (FILE *) data;
+  if (event == DONE)
+  { return(0); }
+  else if (event != ITEM)
+  { return(-1); }
+
+  if (fputs("{\"path\":\"", file) == EOF
+      || tractorbeam_json_escape(file, ppath, strlen(ppath)) != 0
+      || fputc('/', file) == EOF
+      || tractorbeam_json_escape(file, name, strlen(name)) != 0
+      || fputc('"', file) == EOF)
+  { return(-1); }
+
+  if (stat != NULL
+      && fprintf(file, ",\"version\":%d,\"cversion\":%d,\"aversion\":%d,\"czxid\":\"0x%llx\",\"mzxid\":\"0x%llx\","
+                       "\"pzxid\":\"0x%llx\",\"ctime\":%lld,\"mtime\":%lld,\"ephemeral_owner\":\"0x%llx\",\"size\":%d,"
+                       "\"children\":%d",
+                 stat->version, stat->cversion, stat->aversion,
+                 (unsigned long long) stat->czxid, (unsigned long long) stat->mzxid, (unsigned long long) stat->pzxid,
+                 (long long) stat->ctime, (long long) stat->mtime, (unsigned long long) stat->ephemeral_owner,
+                 stat->data_length, stat->num_children) < 0)
+  { return(-1); }
+
+  int rc;
+  if (contsize == 0 && stat != NULL && stat->data_length > 0)
+  { rc = (fputs(",\"data\":null", file) == EOF) ? -1 : 0; }
+  else if (tractorbeam_json_utf8(contents, contsize))
+  {
+    rc = (fputs(",\"data\":\"", file) == EOF
+          || tractorbeam_json_escape(file, contents, contsize) != 0
+          || fputc('"', file) == EOF) ? -1 : 0;
+  }
+  else
+  {
+    rc = (fputs(",\"data_base64\":\"", file) == EOF
+          || tractorbeam_json_base64(file, contents, contsize) != 0
+          || fputc('"', file) == EOF) ? -1 : 0;
+  }
+  if (rc != 0 || fputs("}\n", file) == EOF)
+  { return(-1); }
+  return(0);
+}
+
+/* Output files are written into a temporary file next to them, which
+ * replaces them only once the snapshot succeeds, so readers never see
+ * a partial dump and a failure keeps the previous one (see
+ * tbh_replace_open).
+ */
+static
+FILE *__tbzkrcv_open(const char *output, char **tmp)
+{
+  FILE *file = NULL;
+
+  *tmp = NULL;
+  if (strcmp(output, "-") == 0)
+  { file = stdout; }
+  else if ((file = tbh_replace_open(output, tmp)) == NULL)
+  { return(NULL); }
+  setvbuf(file, NULL, _IOFBF, ZKRECV_WRITE_BUFSIZE);
+  return(file);
+}
+
+static
+int __tbzkrcv_close(FILE *file, const char *output, char *tmp, int rc)
+{
+  if (tmp != NULL)
+  { return(tbh_replace_close(file, output, tmp, rc)); }
+  if (fflush(file) != 0)
+  { rc = -1; }
+  return(rc);
+}
+
+static
+int __tbzkrcv_shm_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  tractorbeam_shmpub_t *shm = (tractorbeam_shmpub_t *) data;
+  UNUSED(stat);
+  if (event == DONE)
+  { return(tractorbeam_shmpub_commit(shm)); }
+  else if (event != ITEM)
+  { return(-1); }
+
+  return(tractorbeam_shmpub_add(shm, ppath, name, contents, contsize));
+}
+
+static
+int __tbzkrcv_null_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  UNUSED(ppath);
+  UNUSED(name);
+  UNUSED(contents);
+  UNUSED(contsize);
+  UNUSED(stat);
+  UNUSED(data);
+  return((event == FAIL) ? -1 : 0);
+}
+
+static
+tractorbeam_monitor_t *__tbzkrcv_connect(tractorbeam_zkrecv_t *info)
+{
+  char *endpoint = NULL;
+  if (info->rebalance)
+  { endpoint = tractorbeam_probe_sort(info->endpoint, TBP_TIMEOUT); }
+
+  tractorbeam_monitor_t *mh = tractorbeam_monitor_init((endpoint == NULL) ? info->endpoint : endpoint, info->path, info->timeout);
+  free(endpoint);
   if (mh == NULL)
   {
     TB_DEBUG0("error connecting to zookeeper");
+    return(NULL);
+  }
+  tractorbeam_monitor_names(mh, (size_t) info->names_memory, info->sorted || info->diff_against != NULL || info->digests != NULL);
+  tractorbeam_monitor_buffer(mh, (size_t) info->max_data);
+  tractorbeam_monitor_data(mh, info->data, (size_t) info->lazy_limit);
+  if (tractorbeam_monitor_filter(mh, info->includes, info->nincludes, info->excludes, info->nexcludes, info->max_depth) != 0)
+  {
+    TB_DEBUG0("error configuring filter");
+    tractorbeam_monitor_term(mh);
+    return(NULL);
+  }
+  if (tractorbeam_monitor_ratelimit(mh, info->max_rps, info->max_bps, info->target_latency) != 0)
+  {
+    TB_DEBUG0("error configuring rate limit");
+    tractorbeam_monitor_term(mh);
+    return(NULL);
+  }
+  return(mh);
+}
+
+static
+int __tbzkrcv_walk(tractorbeam_zkrecv_t *info, tractorbeam_monitor_t *mh, tb_snapshot_fn callback, void *data)
+{
+  if (info->from_snapshot != NULL)
+  { return(tractorbeam_datadir_snapshot(info->from_snapshot, info->path, info->zxid, callback, data)); }
+  return(tractorbeam_monitor_snapshot(mh, info->path, callback, data));
+}
+
+static
+int __tbzkrcv_digest(tractorbeam_zkrecv_t *info, tractorbeam_monitor_t *mh, tb_snapshot_fn callback, void *data)
+{
+  if (info->digests == NULL)
+  { return(__tbzkrcv_walk(info, mh, callback, data)); }
+
+  int rc                   = -1;
+  FILE *file               = fopen(info->digests, "w");
+  tractorbeam_digest_t *dg = (file == NULL) ? NULL : tractorbeam_digest_init(file, callback, data);
+  if (dg == NULL)
+  { TB_DEBUG("could not open file: %s", info->digests); }
+  else
+  {
+    rc = __tbzkrcv_walk(info, mh, tractorbeam_digest_cc, dg);
+    tractorbeam_digest_term(dg);
+  }
+  if (file != NULL && fclose(file) != 0)
+  { rc = -1; }
+  return(rc);
+}
+
+typedef struct
+{
+  tractorbeam_tree_t *tree;
+  tb_snapshot_fn callback;
+  void *data;
+} tbzkrcv_collect_t;
+
+static
+int __tbzkrcv_collect_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  tbzkrcv_collect_t *c = (tbzkrcv_collect_t *) data;
+  if (event == ITEM && tractorbeam_tree_add(c->tree, ppath, name, contents, contsize) != 0)
+  { return(-1); }
+  return(c->callback(event, ppath, name, contents, contsize, stat, c->data));
+}
+
+/* Templates are rendered from a copy of the tree kept in memory, once
+ * the snapshot has been written. */
+static
+int __tbzkrcv_snapshot(tractorbeam_zkrecv_t *info, tractorbeam_monitor_t *mh, tb_snapshot_fn callback, void *data)
+{
+  if (info->ntemplates == 0)
+  { return(__tbzkrcv_digest(info, mh, callback, data)); }
+
+  tractorbeam_template_t **templates = (tractorbeam_template_t **) calloc((size_t) info->ntemplates, sizeof(tractorbeam_template_t *));
+  tbzkrcv_collect_t c;
+  int k, rc = -1;
+
+  c.tree     = tractorbeam_tree_init();
+  c.callback = callback;
+  c.data     = data;
+  if (templates == NULL || c.tree == NULL)
+  { goto handle_error; }
+  for (k=0; k<info->ntemplates; k+=1)
+  {
+    if ((templates[k] = tractorbeam_template_init(info->templates[k])) == NULL)
+    { goto handle_error; }
+  }
+
+  if ((rc = __tbzkrcv_digest(info, mh, __tbzkrcv_collect_cc, &c)) != 0)
+  { goto handle_error; }
+  tractorbeam_tree_seal(c.tree);
+  for (k=0; k<info->ntemplates; k+=1)
+  {
+    if (tractorbeam_template_render(templates[k], c.tree) == -1)
+    { rc = -1; }
+  }
+
+handle_error:
+  for (k=0; templates != NULL && k<info->ntemplates; k+=1)
+  { tractorbeam_template_term(templates[k]); }
+  free(templates);
+  tractorbeam_tree_term(c.tree);
+  return(rc);
+}
+
+typedef struct
+{
+  FILE *dump;
+  FILE *prev;
+  FILE *changes;
+  FILE *versions;
+  FILE *prevversions;
+  size_t maxsize;
+  int prevok;
+  int prevversion;
+  char *prevvline;
+  size_t prevvlinesize;
+  char *prevpath;
+  size_t prevpathsize;
+  char *prevlast;
+  size_t prevlastsize;
+  char *prevdata;
+  size_t prevdatasize;
+  size_t prevsize;
+  char *path;
+  size_t pathsize;
+  char *last;
+  size_t lastsize;
+  int haslast;
+} tbzkrcv_diff_t;
+
+/* The order of a sorted walk, in which a node comes right before its
+ * children: '/' goes before any other byte. */
+static
+int __tbzkrcv_pathcmp(const char *a, const char *b)
+{
+  for (; a[0] != '\0' && a[0] == b[0]; a++, b++)
+  { }
+  int ca = (a[0] == '\0') ? 0 : ((a[0] == '/') ? 1 : (unsigned char) a[0] + 1);
+  int cb = (b[0] == '\0') ? 0 : ((b[0] == '/') ? 1 : (unsigned char) b[0] + 1);
+  return(ca - cb);
+}
+
+static
+void __tbzkrcv_swap(char **a, size_t *asize, char **b, size_t *bsize)
+{
+  char *tmp    = *a;
+  size_t tmpsz = *asize;
+  *a           = *b;
+  *asize       = *bsize;
+  *b           = tmp;
+  *bsize       = tmpsz;
+}
+
+/* Reads the next record (<PATH> "|" <SIZE> "\n" <CONTENTS> "\n") of
+ * the previous dump. */
+static
+int __tbzkrcv_diff_next(tbzkrcv_diff_t *d)
+{
+  __tbzkrcv_swap(&d->prevpath, &d->prevpathsize, &d->prevlast, &d->prevlastsize);
+  ssize_t len = getline(&d->prevpath, &d->prevpathsize, d->prev);
+  if (len == -1)
+  {
+    d->prevok = 0;
+    return(ferror(d->prev) ? -1 : 0);
+  }
+
+  char *bar = strrchr(d->prevpath, '|');
+  if (bar == NULL)
+  {
+    TB_DEBUG0("corrupted previous dump");
+    return(-1);
+  }
+  bar[0]      = '\0';
+  d->prevsize = (size_t) strtoul(bar + 1, NULL, 10);
+  if (d->prevok && __tbzkrcv_pathcmp(d->prevlast, d->prevpath) >= 0)
+  {
+    TB_DEBUG0("previous dump not sorted (use --sorted)");
+    return(-1);
+  }
+  if (tbh_grow(&d->prevdata, &d->prevdatasize, d->prevsize + 1, 4096, d->maxsize + 1) != 0
+      || fread(d->prevdata, sizeof(char), d->prevsize + 1, d->prev) != d->prevsize + 1)
+  {
+    TB_DEBUG0("corrupted previous dump");
     return(-1);
   }
 
-  int rc = -1;
-  if (info->layout == ZKRECV_LAYOUT_FILE)
+  // <PATH> "|" <VERSION> "\n", one per record (if there are versions)
+  d->prevversion = -1;
+  if (d->prevversions != NULL)
   {
-    int dash   = strcmp(info->output, "-");
-    FILE *file = (dash == 0) ? stdout : fopen(info->output, "w");
-    if (file != NULL)
+    len = getline(&d->prevvline, &d->prevvlinesize, d->prevversions);
+    bar = (len == -1) ? NULL : strrchr(d->prevvline, '|');
+    if (bar != NULL)
+    { bar[0] = '\0'; }
+    if (bar == NULL || strcmp(d->prevvline, d->prevpath) != 0)
     {
-      rc = tractorbeam_monitor_snapshot(mh, info->path, __tbzkrcv_file_cc, file);
-      if (dash != 0)
-      { fclose(file); }
+      TB_DEBUG0("versions do not match the previous dump");
+      return(-1);
     }
-    else
+    d->prevversion = (int) strtol(bar + 1, NULL, 10);
+  }
+  d->prevok = 1;
+  return(0);
+}
+
+/* Versions that are not known (the previous dump has no versions
+ * file) are written as -1. */
+static
+int __tbzkrcv_change(FILE *file, char op, const char *path, int oldversion, int newversion, const void *contents, size_t contsize)
+{
+  int rc;
+  if (op == '-')
+  { return((fprintf(file, "-%s|%d\n", path, oldversion) > 0) ? 0 : -1); }
+  else if (op == '+')
+  { rc = fprintf(file, "+%s|%d|%zu\n", path, newversion, contsize); }
+  else
+  { rc = fprintf(file, "~%s|%d|%d|%zu\n", path, oldversion, newversion, contsize); }
+
+  if (rc > 0 &&
+      fwrite(contents, sizeof(char), contsize, file) > 0 &&
+      fprintf(file, "\n") > 0)
+  { return(0); }
+  return(-1);
+}
+
+/* Merges the tree, as it gets read, with the previous dump (both in
+ * the same order), writing the dump as well as the changes. */
+static
+int __tbzkrcv_diff_cc(tb_snapshot_events event, const char *ppath, const char *name, const void *contents, size_t contsize, const tb_stat_t *stat, void *data)
+{
+  tbzkrcv_diff_t *d = (tbzkrcv_diff_t *) data;
+  size_t plen, nlen;
+  int version = -1;
+  if (event == FAIL)
+  { return(-1); }
+  else if (event == ITEM)
+  {
+    // the file layout leaves these out
+    if (contsize == 0)
+    { return(0); }
+
+    plen = strlen(ppath);
+    nlen = strlen(name);
+    if (tbh_grow(&d->path, &d->pathsize, plen + nlen + 2, 256, (size_t) -1) != 0)
+    { return(-1); }
+    memcpy(d->path, ppath, plen);
+    d->path[plen] = '/';
+    memcpy(d->path + plen + 1, name, nlen + 1);
+    if (d->haslast && __tbzkrcv_pathcmp(d->last, d->path) >= 0)
     {
-      rc = -1;
-      TB_DEBUG("could not open file: %s", info->output);
+      TB_DEBUG("tree not sorted: %s", d->path);
+      return(-1);
+    }
+    if (__tbzkrcv_file_cc(ITEM, ppath, name, contents, contsize, stat, d->dump) != 0)
+    { return(-1); }
+    version = (stat == NULL) ? -1 : stat->version;
+    if (d->versions != NULL && fprintf(d->versions, "%s|%d\n", d->path, version) <= 0)
+    { return(-1); }
+  }
+
+  while (d->prevok && (event == DONE || __tbzkrcv_pathcmp(d->prevpath, d->path) < 0))
+  {
+    if (__tbzkrcv_change(d->changes, '-', d->prevpath, d->prevversion, -1, NULL, 0) != 0 || __tbzkrcv_diff_next(d) != 0)
+    { return(-1); }
+  }
+  if (event == DONE)
+  { return(0); }
+
+  if (d->prevok && strcmp(d->prevpath, d->path) == 0)
+  {
+    // a set with the same contents still bumps the version
+    int modified = d->prevsize != contsize || memcmp(d->prevdata, contents, contsize) != 0
+                   || (d->prevversion != -1 && version != -1 && d->prevversion != version);
+    if (modified && __tbzkrcv_change(d->changes, '~', d->path, d->prevversion, version, contents, contsize) != 0)
+    { return(-1); }
+    if (__tbzkrcv_diff_next(d) != 0)
+    { return(-1); }
+  }
+  else if (__tbzkrcv_change(d->changes, '+', d->path, -1, version, contents, contsize) != 0)
+  { return(-1); }
+
+  __tbzkrcv_swap(&d->path, &d->pathsize, &d->last, &d->lastsize);
+  d->haslast = 1;
+  return(0);
+}
+
+/* The versions of the dump are written into <OUTPUT>.versions (in
+ * the same order), as the file layout has no room for them, and read
+ * back from <PREV>.versions, if it exists, on the next run. */
+static
+int __tbzkrcv_diff(tractorbeam_zkrecv_t *info, tractorbeam_monitor_t *mh, FILE *dump)
+{
+  tbzkrcv_diff_t d;
+  int rc = -1;
+  char *ctmp = NULL;
+  char *vtmp = NULL;
+  char *vfile = NULL;
+  char *prevvfile = tbh_join(info->diff_against, ".versions", NULL);
+
+  memset(&d, 0, sizeof(d));
+  d.dump        = dump;
+  d.maxsize     = (size_t) info->max_data;
+  d.prevversion = -1;
+  d.prev        = fopen(info->diff_against, "r");
+  if (prevvfile != NULL)
+  { d.prevversions = fopen(prevvfile, "r"); }
+  if (strcmp(info->output, "-") != 0 && (vfile = tbh_join(info->output, ".versions", NULL)) != NULL)
+  { d.versions = tbh_replace_open(vfile, &vtmp); }
+  d.changes = __tbzkrcv_open(info->changes, &ctmp);
+  if (d.prev == NULL || d.changes == NULL || prevvfile == NULL || (vfile != NULL && d.versions == NULL))
+  { TB_DEBUG("could not open files: %s, %s", info->diff_against, info->changes); }
+  else if (__tbzkrcv_diff_next(&d) == 0)
+  { rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_diff_cc, &d); }
+
+  if (d.prev != NULL)
+  { fclose(d.prev); }
+  if (d.prevversions != NULL)
+  { fclose(d.prevversions); }
+  if (d.versions != NULL)
+  { rc = tbh_replace_close(d.versions, vfile, vtmp, rc); }
+  if (d.changes != NULL)
+  { rc = __tbzkrcv_close(d.changes, info->changes, ctmp, rc); }
+  free(prevvfile);
+  free(vfile);
+  free(d.prevvline);
+  free(d.prevpath);
+  free(d.prevlast);
+  free(d.prevdata);
+  free(d.path);
+  free(d.last);
+  return(rc);
+}
+
+int tractorbeam_zkrecv(tractorbeam_zkrecv_t *info)
+{
+  tractorbeam_monitor_t *mh = NULL;
+  if (info->from_snapshot == NULL && (mh = __tbzkrcv_connect(info)) == NULL)
+  { return(-1); }
+
+  int rc = -1;
+  if (info->output[0] == '\0')
+  { rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_null_cc, NULL); }
+  else if (info->layout == ZKRECV_LAYOUT_FILE || info->layout == ZKRECV_LAYOUT_STAT || info->layout == ZKRECV_LAYOUT_JSON)
+  {
+    char *tmp;
+    FILE *file = __tbzkrcv_open(info->output, &tmp);
+    if (file != NULL)
+    {
+      if (info->diff_against != NULL)
+      { rc = __tbzkrcv_diff(info, mh, file); }
+      else if (info->layout == ZKRECV_LAYOUT_STAT)
+      { rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_stat_cc, file); }
+      else if (info->layout == ZKRECV_LAYOUT_JSON)
+      { rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_json_cc, file); }
+      else
+      { rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_file_cc, file); }
+      rc = __tbzkrcv_close(file, info->output, tmp, rc);
     }
   }
   else if (info->layout == ZKRECV_LAYOUT_FILESYSTEM)
   {
     mkdir(info->output, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-    rc = tractorbeam_monitor_snapshot(mh, info->path, __tbzkrcv_filesystem_cc, info->output);
+    if (info->io_threads > 0)
+    {
+      tbzkrcv_fs_t fs;
+      fs.output = info->output;
+      fs.writer = tractorbeam_fswriter_init(info->io_threads, ZKRECV_FSWRITER_MEMORY);
+      if (fs.writer != NULL)
+      {
+        rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_fswriter_cc, &fs);
+        if (tractorbeam_fswriter_term(fs.writer) != 0)
+        { rc = -1; }
+      }
+    }
+    else
+    { rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_filesystem_cc, info->output); }
+  }
+  else if (info->layout == ZKRECV_LAYOUT_SHM)
+  {
+    tractorbeam_shmpub_t *shm = tractorbeam_shmpub_init(info->output, (size_t) info->shm_size);
+    if (shm != NULL)
+    {
+      rc = __tbzkrcv_snapshot(info, mh, __tbzkrcv_shm_cc, shm);
+      tractorbeam_shmpub_term(shm);
+    }
   }
-  tractorbeam_monitor_term(mh);
+  if (mh != NULL)
+  { tractorbeam_monitor_term(mh); }
   return(rc);
 }
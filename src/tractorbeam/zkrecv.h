@@ -28,12 +28,16 @@
 #ifndef __tractorbeam_zkrecv_h__
 #define __tractorbeam_zkrecv_h__
 
+#include <stdint.h>
 #include "tractorbeam/monitor.h"
 
 typedef enum
 {
   ZKRECV_LAYOUT_FILE,
-  ZKRECV_LAYOUT_FILESYSTEM
+  ZKRECV_LAYOUT_FILESYSTEM,
+  ZKRECV_LAYOUT_SHM,
+  ZKRECV_LAYOUT_STAT,
+  ZKRECV_LAYOUT_JSON
 } tb_zkrecv_layout_e;
 
 typedef struct
@@ -43,6 +47,29 @@ typedef struct
   char *output;
   int delay;
   int timeout;
+  int rebalance;
+  int max_rps;
+  long max_bps;
+  int target_latency;
+  long names_memory;
+  long max_data;
+  long shm_size;
+  char *from_snapshot;
+  int64_t zxid;
+  char *diff_against;
+  char *changes;
+  char *digests;
+  char **templates;
+  int ntemplates;
+  char **includes;
+  int nincludes;
+  char **excludes;
+  int nexcludes;
+  int max_depth;
+  tb_monitor_data_e data;
+  long lazy_limit;
+  int io_threads;
+  int sorted;
   tb_zkrecv_layout_e layout;
 } tractorbeam_zkrecv_t;
 
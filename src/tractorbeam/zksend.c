@@ -25,16 +25,62 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+# include <malloc.h>
+#endif
 #include "tractorbeam/exec.h"
+#include "tractorbeam/watch.h"
+#include "tractorbeam/fanout.h"
 #include "tractorbeam/debug.h"
 #include "tractorbeam/zksend.h"
 #include "tractorbeam/monitor.h"
+#include "tractorbeam/helpers.h"
 
 #define ZKSEND_BUFSIZE 1048576
+#define ZKSEND_LEAN_STACKSIZE 262144
+#define ZKSEND_LEAN_TRIM 65536
+
+static
+void __zksend_lean(void)
+{
+#ifdef __GLIBC__
+  pthread_attr_t attr;
+
+  // one malloc arena for all threads and give freed memory back early
+  mallopt(M_ARENA_MAX, 1);
+  mallopt(M_TRIM_THRESHOLD, ZKSEND_LEAN_TRIM);
+
+  // applies to the threads zookeeper starts (io and completion) and
+  // to the reconnector
+  if (pthread_attr_init(&attr) == 0)
+  {
+    if (pthread_attr_setstacksize(&attr, ZKSEND_LEAN_STACKSIZE) != 0
+        || pthread_setattr_default_np(&attr) != 0)
+    { TB_DEBUG0("could not change the default thread stack size"); }
+    pthread_attr_destroy(&attr);
+  }
+#else
+  TB_DEBUG0("lean mode is not supported on this platform");
+#endif
+}
+
+static
+long __zksend_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
 
 static
 void __zksend_debug_rt(tractorbeam_zksend_t *rt)
@@ -52,52 +98,360 @@ void __zksend_debug_rt(tractorbeam_zksend_t *rt)
   TB_DEBUG("using: %s", buffer);
 }
 
-int tractorbeam_zksend(tractorbeam_zksend_t *rt)
+typedef struct
 {
-  char buffer[ZKSEND_BUFSIZE];
-  int status;
+  tractorbeam_monitor_t *mh;
+  char *buffer;
+  size_t bufsize;
+  int fanout;
+  tractorbeam_fanout_t *published;
+  tractorbeam_fanout_t *current;
+  int up;
+  int failures;
+  int successes;
+  unsigned long suppressed_removals;
+  unsigned long suppressed_creations;
+  int haslast;
+  char *last;
+  size_t lastcap;
+  size_t lastsize;
+  long lastwrite;
+} zksend_state_t;
 
-  __zksend_debug_rt(rt);
-  tractorbeam_monitor_t *mh = tractorbeam_monitor_init(rt->endpoint, rt->path, rt->timeout);
-  if (mh == NULL)
+static
+void __zksend_swap(zksend_state_t *st)
+{
+  tractorbeam_fanout_t *tmp = st->published;
+  st->published = st->current;
+  st->current   = tmp;
+}
+
+/* Returns 0 once the data has been written. */
+static
+int __zksend_write(zksend_state_t *st, const char *data, size_t size)
+{
+  if (! st->fanout)
+  { return(tractorbeam_monitor_update(st->mh, data, size)); }
+  if (tractorbeam_fanout_parse(st->current, data, size) != 0)
   {
-    TB_DEBUG0("error connecting to zookeeper");
+    TB_DEBUG0("error parsing output");
     return(-1);
   }
 
+  int rc = tractorbeam_monitor_fanout(st->mh, st->published, st->current);
+  if (rc == 0)
+  { __zksend_swap(st); }
+  return(rc);
+}
+
+static
+void __zksend_erase(zksend_state_t *st)
+{
+  if (! st->fanout)
+  { tractorbeam_monitor_delete(st->mh); }
+  else
+  {
+    tractorbeam_fanout_clear(st->current);
+    if (tractorbeam_monitor_fanout(st->mh, st->published, st->current) == 0)
+    { __zksend_swap(st); }
+  }
+}
+
+/* Returns true when the output is the same as the last one written. */
+static
+int __zksend_unchanged(zksend_state_t *st, size_t size)
+{ return(st->haslast && st->lastsize == size && (size == 0 || memcmp(st->last, st->buffer, size) == 0)); }
+
+/* Keeps a copy of the output just written, to compare the next ones
+ * against. */
+static
+void __zksend_written(zksend_state_t *st, size_t size)
+{
+  st->haslast = 0;
+  if (size > 0 && tbh_grow(&st->last, &st->lastcap, size, size, ZKSEND_BUFSIZE) != 0)
+  { return; }
+  if (size > 0)
+  { memcpy(st->last, st->buffer, size); }
+  st->lastsize = size;
+  st->haslast  = 1;
+}
+
+/* Hysteresis: the node goes away only after fail_threshold consecutive
+ * failures, and comes back only after recover_threshold consecutive
+ * successes. Transitions held back are counted.
+ *
+ * Returns 0 once the output has been written, 1 if it has been held
+ * back and -1 if it could not be written.
+ */
+static
+int __zksend_update(tractorbeam_zksend_t *rt, zksend_state_t *st, size_t size)
+{
+  st->failures   = 0;
+  st->successes += 1;
+  if (! st->up && st->successes < rt->recover_threshold)
+  {
+    st->suppressed_creations += 1;
+    TB_DEBUG("success %d/%d; [not publishing] (suppressed creations: %lu)", st->successes, rt->recover_threshold, st->suppressed_creations);
+    return(1);
+  }
+
+  st->up = 1;
+  if (__zksend_write(st, st->buffer, size) != 0)
+  {
+    TB_DEBUG0("error writing output");
+    return(-1);
+  }
+  return(0);
+}
+
+static
+void __zksend_remove(tractorbeam_zksend_t *rt, zksend_state_t *st)
+{
+  st->haslast = 0;
+  st->successes = 0;
+  st->failures += 1;
+  if (! st->up)
+  { return; }
+
+  if (st->failures < rt->fail_threshold)
+  {
+    st->suppressed_removals += 1;
+    TB_DEBUG("failure %d/%d; [keeping node] (suppressed removals: %lu)", st->failures, rt->fail_threshold, st->suppressed_removals);
+    return;
+  }
+
+  st->up = 0;
+  if (rt->degraded != NULL)
+  {
+    TB_DEBUG0("[publishing degraded marker]");
+    __zksend_write(st, rt->degraded, strlen(rt->degraded));
+  }
+  else
+  {
+    TB_DEBUG0("[removing node]");
+    __zksend_erase(st);
+  }
+}
+
+static
+void __zksend_publish(tractorbeam_zksend_t *rt, zksend_state_t *st, const char *file, int rc)
+{
+  if (rc == -2)
+  {
+    TB_DEBUG("%s: no such file", file);
+    __zksend_remove(rt, st);
+  }
+  else if (rc == -3)
+  {
+    TB_DEBUG("%s: contents too large", file);
+    __zksend_remove(rt, st);
+  }
+  else if (rc >= 0)
+  { __zksend_update(rt, st, rc); }
+  else
+  {
+    TB_DEBUG("%s: error reading", file);
+    __zksend_remove(rt, st);
+  }
+}
+
+static
+int __zksend_exec(tractorbeam_zksend_t *rt, zksend_state_t *st)
+{
+  int status;
+  int delay = rt->min_delay;
+
+  __zksend_debug_rt(rt);
   do
   {
-    int rc = tractorbeam_exec(rt->exec, rt->argv, rt->delay, &status, buffer, ZKSEND_BUFSIZE);
+    int unchanged = 0;
+    int rc = tractorbeam_exec(rt->exec, rt->argv, rt->min_delay, &status, &st->buffer, &st->bufsize, ZKSEND_BUFSIZE);
     if (rc == -2)
     {
-      TB_DEBUG("%s: timeout; [removing node]", rt->exec);
-      tractorbeam_monitor_delete(mh);
+      TB_DEBUG("%s: timeout", rt->exec);
+      __zksend_remove(rt, st);
     }
     else if (rc == -3)
     {
-      TB_DEBUG("%s: output too large; [removing node]", rt->exec);
-      tractorbeam_monitor_delete(mh);
+      TB_DEBUG("%s: output too large", rt->exec);
+      __zksend_remove(rt, st);
     }
     else if (rc >= 0)
     {
       if (status != 0)
       {
-        TB_DEBUG("%s: exit code == %d; [removing node]", rt->exec, status);
-        tractorbeam_monitor_delete(mh);
+        TB_DEBUG("%s: exit code == %d", rt->exec, status);
+        __zksend_remove(rt, st);
       }
       else
-      { tractorbeam_monitor_update(mh, buffer, rc); }
+      {
+        // adaptive mode: the monitor keeps (and restores) the znode,
+        // so the same output is only written again every max_delay,
+        // in case restoring it has not worked. Fanout children are
+        // only restored by writing them, which only touches the
+        // missing ones
+        long now  = __zksend_now();
+        unchanged = __zksend_unchanged(st, rc);
+        int stale = unchanged && now - st->lastwrite >= rt->max_delay * 1000L;
+        if (! unchanged || stale || st->fanout || ! st->up || rt->max_delay == rt->min_delay)
+        {
+          int written = __zksend_update(rt, st, rc);
+          if (written == 0)
+          { st->lastwrite = now; }
+          if (written == 0 && ! unchanged)
+          { __zksend_written(st, rc); }
+          else if (written != 0)
+          {
+            st->haslast = 0;
+            unchanged   = 0;
+          }
+          else if (stale)
+          {
+            TB_DEBUG0("output unchanged; [rewritten]");
+            unchanged = 0;
+          }
+        }
+      }
     }
     else
     {
-      TB_DEBUG("%s: error running; [removing node]", rt->exec);
-      tractorbeam_monitor_delete(mh);
+      TB_DEBUG("%s: error running", rt->exec);
+      __zksend_remove(rt, st);
     }
 
-    sleep(rt->delay);
+    // backs off while the output does not change, snaps back to
+    // min_delay on changes, failures and rewrites
+    if (! unchanged)
+    { delay = rt->min_delay; }
+    else if (delay < rt->max_delay)
+    {
+      delay = (delay * 2 > rt->max_delay) ? rt->max_delay : delay * 2;
+      TB_DEBUG("output unchanged; [delay: %ds]", delay);
+    }
+    sleep(delay);
   } while (1);
 
-  tractorbeam_monitor_term(mh);
+  return(-1);
+}
+
+static
+int __zksend_watch(tractorbeam_zksend_t *rt, zksend_state_t *st)
+{
+  long last   = 0;
+  int pending = 1;
+
+  TB_DEBUG("watching: %s", rt->watch);
+  tractorbeam_watch_t *wh = tractorbeam_watch_init(rt->watch);
+  if (wh == NULL)
+  { return(-1); }
+
+  // changes are coalesced so that at most one update gets published
+  // every min_interval
+  while (1)
+  {
+    int timeout = -1;
+    if (pending)
+    {
+      long now = __zksend_now();
+      if (last == 0 || now - last >= rt->min_interval)
+      {
+        int rc = tractorbeam_watch_read(rt->watch, &st->buffer, &st->bufsize, ZKSEND_BUFSIZE);
+        __zksend_publish(rt, st, rt->watch, rc);
+        last    = now;
+        pending = 0;
+      }
+      else
+      { timeout = (int) (rt->min_interval - (now - last)); }
+    }
+
+    int rc = tractorbeam_watch_wait(wh, timeout);
+    if (rc == -1)
+    {
+      TB_DEBUG("%s: error watching", rt->watch);
+      break;
+    }
+    pending = pending || rc == 1;
+  }
+
+  tractorbeam_watch_term(wh);
+  return(-1);
+}
+
+static
+int __zksend_fifo(tractorbeam_zksend_t *rt, zksend_state_t *st)
+{
+  struct stat fst;
+  long last = 0;
+
+  TB_DEBUG("reading: %s", rt->fifo);
+  if (stat(rt->fifo, &fst) != 0 || !S_ISFIFO(fst.st_mode))
+  {
+    TB_DEBUG("%s: not a fifo", rt->fifo);
+    return(-1);
+  }
+
+  // writers block on open while we wait for min_interval to elapse
+  while (1)
+  {
+    long wait = (last == 0) ? 0 : rt->min_interval - (__zksend_now() - last);
+    if (wait > 0)
+    {
+      struct timespec ts;
+      ts.tv_sec  = wait / 1000;
+      ts.tv_nsec = (wait % 1000) * 1000000;
+      nanosleep(&ts, NULL);
+    }
+
+    int rc = tractorbeam_watch_read(rt->fifo, &st->buffer, &st->bufsize, ZKSEND_BUFSIZE);
+    __zksend_publish(rt, st, rt->fifo, rc);
+    last = __zksend_now();
+  }
 
   return(-1);
 }
+
+int tractorbeam_zksend(tractorbeam_zksend_t *rt)
+{
+  zksend_state_t st;
+  int rc = -1;
+
+  if (rt->lean)
+  { __zksend_lean(); }
+
+  st.fanout    = rt->fanout;
+  st.buffer    = NULL;
+  st.bufsize   = 0;
+  st.published = tractorbeam_fanout_init();
+  st.current   = tractorbeam_fanout_init();
+  st.up        = 1;
+  st.failures   = 0;
+  st.successes  = 0;
+  st.suppressed_removals  = 0;
+  st.suppressed_creations = 0;
+  st.haslast    = 0;
+  st.last       = NULL;
+  st.lastcap    = 0;
+  st.lastsize   = 0;
+  st.lastwrite  = 0;
+  st.mh        = tractorbeam_monitor_init(rt->endpoint, rt->path, rt->timeout);
+  if (st.mh == NULL)
+  { TB_DEBUG0("error connecting to zookeeper"); }
+  else if (st.published != NULL && st.current != NULL)
+  {
+    if (rt->watch != NULL)
+    { rc = __zksend_watch(rt, &st); }
+    else if (rt->fifo != NULL)
+    { rc = __zksend_fifo(rt, &st); }
+    else
+    { rc = __zksend_exec(rt, &st); }
+  }
+
+  if (st.mh != NULL)
+  { tractorbeam_monitor_term(st.mh); }
+  tractorbeam_fanout_term(st.published);
+  tractorbeam_fanout_term(st.current);
+  free(st.buffer);
+  free(st.last);
+
+  return(rc);
+}
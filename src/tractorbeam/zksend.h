@@ -33,9 +33,19 @@ typedef struct
   char *endpoint;
   char *path;
   char *exec;
+  char *watch;
+  char *fifo;
   char **argv;
   int delay;
+  int min_delay;
+  int max_delay;
   int timeout;
+  int min_interval;
+  int fanout;
+  int fail_threshold;
+  int recover_threshold;
+  char *degraded;
+  int lean;
 } tractorbeam_zksend_t;
 
 /*! Executes the tractorbeam send loop (this function never returns).